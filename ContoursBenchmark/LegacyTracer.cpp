@@ -0,0 +1,137 @@
+#include "LegacyTracer.h"
+#include <stack>
+
+namespace
+{
+	std::vector<cv::Point> getOrder(cv::Point pt, Direction direction)
+	{
+		switch (direction)
+		{
+		case Direction::TOP:
+			return { cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1) };
+		case Direction::TOP_RIGHT:
+			return { cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y) };
+		case Direction::RIGHT:
+			return { cv::Point(pt.x + 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1) };
+		case Direction::BOTTOM_RIGHT:
+			return { cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x, pt.y - 1) };
+		case Direction::DOWN:
+			return { cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1) };
+		case Direction::BOTTOM_LEFT:
+			return { cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y) };
+		case Direction::LEFT:
+			return { cv::Point(pt.x - 1, pt.y), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x + 1, pt.y - 1) };
+		case Direction::TOP_LEFT:
+			return { cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y) };
+		default:
+			return { cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1) };
+		}
+	}
+
+	void extractContour(int x_start, int y_start, cv::Mat& img, std::vector<cv::Point>& contour)
+	{
+		int width = img.cols;
+		int height = img.rows;
+
+		int x = x_start;
+		int y = y_start;
+
+		auto isContour = [&](int x, int y) -> bool
+			{
+				if (x < 0 || x >= width || y < 0 || y >= height)
+				{
+					return false;
+				}
+				return img.at<uchar>(y, x) == 255;
+			};
+
+		std::stack<cv::Point> stack;
+
+		stack.push(cv::Point(x, y));
+
+		Direction direction = Direction::NONE;
+
+		cv::Point prev_point = cv::Point(x, y);
+
+		bool reverse = false;
+
+		while (!stack.empty())
+		{
+			cv::Point p = stack.top();
+			stack.pop();
+
+			if (img.at<uchar>(p.y, p.x) == 255)
+			{
+				contour.push_back(p);
+				img.at<uchar>(p.y, p.x) = 0;
+			}
+
+			direction = ContoursOperations::getDirection(prev_point, p);
+
+			std::vector<cv::Point> neighbours = getOrder(p, direction);
+
+			for (const auto& n : neighbours)
+			{
+				if (isContour(n.x, n.y))
+				{
+					stack.push(n);
+					break;
+				}
+			}
+
+			prev_point = p;
+
+			if (stack.empty())
+			{
+				if (!reverse)
+				{
+					reverse = true;
+
+					cv::Point point(x, y);
+
+					stack.push(point);
+					std::reverse(contour.begin(), contour.end());
+					prev_point = point;
+				}
+			}
+		}
+	}
+}
+
+void LegacyTracer::findContours(const cv::Mat& img, std::vector<Contour>& contours)
+{
+	int width = img.cols;
+	int height = img.rows;
+
+	cv::Mat mat = img.clone();
+	for (int m = 0; m < height; ++m)
+	{
+		for (int n = 0; n < width; ++n)
+		{
+			if (mat.at<uchar>(m, n) == 255)
+			{
+				Contour c;
+				extractContour(n, m, mat, c.points);
+				contours.push_back(std::move(c));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		Contour& c = contours[i];
+		c.index = i;
+		c.value = i + 1;
+
+		bool isClosed = true;
+
+		if (cv::norm(contours[i].points.front() - contours[i].points.back()) > 3)
+		{
+			isClosed = false;
+		}
+
+		c.isClosed = isClosed;
+
+		c.boundingRect = cv::boundingRect(contours[i].points);
+	}
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "ContoursOperations.h"
+
+// Tracer used before the table based ContoursOperations::findContours, kept as a reference for the benchmark
+namespace LegacyTracer
+{
+    void findContours(const cv::Mat& img, std::vector<Contour>& contours);
+}
@@ -0,0 +1,550 @@
+#include <QtGui/QGuiApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QPainterPath>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/photo.hpp>
+#include <opencv2/ximgproc.hpp>
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "EncodeOperations.h"
+#include "ImageGenerator.h"
+#include "LabelPlacer.h"
+#include "LegacyTracer.h"
+#include "PerlinNoise.hpp"
+#include "RandomGenerator.h"
+
+namespace
+{
+	const uint64_t kSeed = 12345;
+
+	GenerationParams benchParams(int size)
+	{
+		GenerationParams params{};
+		params.width = size;
+		params.height = size;
+		params.Xmul = 0.005;
+		params.Ymul = 0.005;
+		params.mul = 20;
+		params.generateIsolines = true;
+		params.fillContours = true;
+		params.drawValues = true;
+		params.textDistance = 50;
+		return params;
+	}
+
+	// Best of `repeats` runs in milliseconds
+	double measure(int repeats, const std::function<void()>& func)
+	{
+		double best = 0;
+		for (int i = 0; i < repeats; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			func();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (i == 0 || ms < best)
+			{
+				best = ms;
+			}
+		}
+		return best;
+	}
+
+	// Noise field and gradients in double vs float precision
+	void benchFieldPrecision()
+	{
+		std::printf("field precision\n");
+		std::printf("%6s %12s %12s %8s %14s %14s %14s\n", "size", "double, ms", "float, ms", "speedup", "double, MiB", "float, MiB", "mask diff, px");
+
+		for (int size : { 1024, 2048, 4096 })
+		{
+			GenerationParams params = benchParams(size);
+			cv::Mat maskDouble, maskFloat;
+
+			params.singlePrecision = false;
+			double timeDouble = measure(3, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					maskDouble = ContoursOperations::generateIsolines(params, gen);
+				});
+
+			params.singlePrecision = true;
+			double timeFloat = measure(3, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					maskFloat = ContoursOperations::generateIsolines(params, gen);
+				});
+
+			// field plus both Sobel outputs are alive at the same time
+			double pixels = double(size) * size;
+			double mibDouble = 3 * pixels * sizeof(double) / (1024 * 1024);
+			double mibFloat = 3 * pixels * sizeof(float) / (1024 * 1024);
+			int diff = cv::countNonZero(maskDouble != maskFloat);
+
+			std::printf("%6d %12.1f %12.1f %8.2f %14.1f %14.1f %14d\n", size, timeDouble, timeFloat, timeDouble / timeFloat, mibDouble, mibFloat, diff);
+		}
+		std::printf("\n");
+	}
+
+	// Octave fields of generateField (row evaluator) against normalizedOctave2D_01 per pixel, relative to one octave
+	void benchOctaves()
+	{
+		const int size = 2048;
+		std::printf("octave noise, %dx%d\n", size, size);
+		std::printf("%8s %12s %12s %12s %8s %12s %10s\n", "octaves", "fbm, ms", "per pixel", "speedup", "x single", "ridged, ms", "diff, px");
+
+		GenerationParams params = benchParams(size);
+		double single = measure(3, [&]()
+			{
+				RandomGenerator gen(kSeed);
+				ContoursOperations::generateField(params, gen);
+			});
+
+		for (int octaves : { 1, 2, 4, 6, 8 })
+		{
+			params.octaves = octaves;
+			params.persistence = 0.5;
+
+			cv::Mat field;
+			params.noiseMode = NoiseMode::FBM;
+			double fbm = measure(3, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					field = ContoursOperations::generateField(params, gen);
+				});
+
+			// the same field pixel by pixel, as octave2D evaluates it
+			cv::Mat reference(size, size, CV_64F);
+			RandomGenerator gen(kSeed);
+			const siv::PerlinNoise perlin{ static_cast<siv::PerlinNoise::seed_type>(gen.getRandomInt(INT_MAX)) };
+			double perPixel = measure(1, [&]()
+				{
+#pragma omp parallel for
+					for (int j = 0; j < size; ++j)
+					{
+						double* row = reference.ptr<double>(j);
+						for (int i = 0; i < size; ++i)
+						{
+							row[i] = perlin.normalizedOctave2D_01(i * params.Xmul, j * params.Ymul, octaves, 0.5) * params.mul;
+						}
+					}
+				});
+
+			params.noiseMode = NoiseMode::RIDGED;
+			double ridged = measure(3, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					ContoursOperations::generateField(params, gen);
+				});
+
+			int diff = cv::countNonZero(field != reference);
+			std::printf("%8d %12.1f %12.1f %12.2f %8.2f %12.1f %10d\n", octaves, fbm, perPixel, perPixel / fbm, fbm / single, ridged, diff);
+		}
+		std::printf("\n");
+	}
+
+	// Thinned isolines mask as traced by the raster engine
+	cv::Mat thinnedMask(int size)
+	{
+		GenerationParams params = benchParams(size);
+		RandomGenerator gen(kSeed);
+		cv::Mat mask = cv::Scalar(255) - ContoursOperations::generateIsolines(params, gen);
+
+		cv::Mat thinned;
+		cv::ximgproc::thinning(mask, thinned, cv::ximgproc::THINNING_GUOHALL);
+		return thinned(cv::Rect(1, 1, thinned.cols - 2, thinned.rows - 2)).clone();
+	}
+
+	bool sameContours(const std::vector<Contour>& a, const std::vector<Contour>& b)
+	{
+		if (a.size() != b.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].points != b[i].points || a[i].isClosed != b[i].isClosed)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Contour tracing of a thinned mask: previous tracer vs current one vs OpenCV
+	void benchTracer()
+	{
+		std::printf("contour tracer\n");
+		std::printf("%6s %10s %12s %12s %12s %8s %10s\n", "size", "contours", "legacy, ms", "tables, ms", "opencv, ms", "speedup", "same order");
+
+		const int size = 2048;
+		cv::Mat thinned = thinnedMask(size);
+		std::vector<Contour> legacy, current;
+		std::vector<std::vector<cv::Point>> opencv;
+
+		double timeLegacy = measure(5, [&]()
+			{
+				legacy.clear();
+				LegacyTracer::findContours(thinned, legacy);
+			});
+		double timeCurrent = measure(5, [&]()
+			{
+				current.clear();
+				ContoursOperations::findContours(thinned, current);
+			});
+		double timeOpenCV = measure(5, [&]()
+			{
+				opencv.clear();
+				cv::findContours(thinned, opencv, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+			});
+
+		std::printf("%6d %10zu %12.1f %12.1f %12.1f %8.2f %10s\n", size, current.size(), timeLegacy, timeCurrent, timeOpenCV,
+			timeLegacy / timeCurrent, sameContours(legacy, current) ? "yes" : "NO");
+		std::printf("\n");
+	}
+
+	// Filled drawing with contour pixels still in line colors, and the mask of those pixels
+	void filledDrawing(int size, cv::Mat& drawing, cv::Mat& mask)
+	{
+		std::vector<Contour> contours;
+		cv::Mat thinned = thinnedMask(size);
+		ContoursOperations::findContours(thinned, contours);
+
+		cv::Mat labels = ContoursOperations::labelContours(contours, thinned.size());
+		ContoursOperations::findDepth(labels, contours);
+
+		drawing = cv::Mat::zeros(thinned.size(), CV_8UC3);
+		drawing.setTo(cv::Scalar(75, 75, 75), labels != 0);
+		ContoursOperations::fillContours(labels, contours, drawing);
+		mask = labels != 0;
+	}
+
+	// Contour and border repaint: cv::inpaint TELEA vs neighbour fill and replicated border
+	void benchInpaint()
+	{
+		std::printf("inpaint\n");
+		std::printf("%6s %12s %12s %8s %12s %12s %8s %10s\n", "size", "telea, ms", "fill, ms", "speedup", "border telea", "replicate", "speedup", "mean diff");
+
+		for (int size : { 1024, 2048 })
+		{
+			cv::Mat drawing, mask;
+			filledDrawing(size, drawing, mask);
+
+			cv::Mat telea, fill;
+			double timeTelea = measure(3, [&]()
+				{
+					cv::inpaint(drawing, mask, telea, 3, cv::INPAINT_TELEA);
+				});
+			double timeFill = measure(3, [&]()
+				{
+					fill = drawing.clone();
+					ContoursOperations::fillFromNeighbours(fill, mask);
+				});
+
+			cv::Mat bordered, borderMask;
+			double timeBorderTelea = measure(3, [&]()
+				{
+					cv::copyMakeBorder(telea, bordered, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
+					cv::copyMakeBorder(cv::Mat::zeros(telea.size(), CV_8UC1), borderMask, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(255));
+					cv::inpaint(bordered, borderMask, bordered, 3, cv::INPAINT_TELEA);
+				});
+			double timeReplicate = measure(3, [&]()
+				{
+					cv::copyMakeBorder(fill, bordered, 1, 1, 1, 1, cv::BORDER_REPLICATE);
+				});
+
+			// mean absolute difference per channel on the repainted pixels
+			cv::Mat diff;
+			cv::absdiff(telea, fill, diff);
+			cv::Scalar channels = cv::mean(diff, mask);
+			double meanDiff = (channels[0] + channels[1] + channels[2]) / 3;
+
+			std::printf("%6d %12.1f %12.1f %8.2f %12.1f %12.1f %8.2f %10.2f\n", size, timeTelea, timeFill, timeTelea / timeFill,
+				timeBorderTelea, timeReplicate, timeBorderTelea / timeReplicate, meanDiff);
+		}
+		std::printf("\n");
+	}
+
+	// Contours of the raster engine with depths, as the label stage gets them
+	std::vector<Contour> tracedContours(int size)
+	{
+		std::vector<Contour> contours;
+		cv::Mat thinned = thinnedMask(size);
+		ContoursOperations::findContours(thinned, contours);
+		ContoursOperations::findDepth(ContoursOperations::labelContours(contours, thinned.size()), contours);
+		return contours;
+	}
+
+	// Label stage: line gaps cut by an inverted clip path per contour vs polylines split at the label intervals
+	void benchLabels()
+	{
+		std::printf("labels\n");
+		std::printf("%6s %10s %10s %12s %12s %8s\n", "size", "contours", "labels", "clip, ms", "split, ms", "speedup");
+
+		for (int size : { 1024, 2048 })
+		{
+			std::vector<Contour> contours = tracedContours(size);
+			QImage image(size - 2, size - 2, QImage::Format_BGR888);
+			QFont font;
+			size_t labelCount = 0;
+
+			double timeClip = measure(3, [&]()
+				{
+					image.fill(Qt::white);
+					QPainter painter(&image);
+					LabelPlacer placer(font, &image, 50);
+					painter.setFont(font);
+					labelCount = 0;
+					for (const Contour& contour : contours)
+					{
+						PlacedLabels placed = placer.place(contour);
+						labelCount += placed.labels.size();
+
+						painter.setClipping(false);
+						QPainterPath clipPath;
+						for (const ContourLabel& label : placed.labels)
+						{
+							painter.save();
+							painter.translate(label.position);
+							painter.rotate(label.angle);
+							painter.drawText(label.textRect, Qt::AlignCenter, label.text);
+							painter.restore();
+							clipPath.addPolygon(label.area);
+						}
+
+						QPainterPath clipInv;
+						clipInv.addRect({ 0, 0, INT_MAX, INT_MAX });
+						clipInv -= clipPath;
+						painter.setClipPath(clipInv);
+						DrawOperations::drawContour(painter, contour, QColor(Qt::black));
+					}
+				});
+
+			double timeSplit = measure(3, [&]()
+				{
+					image.fill(Qt::white);
+					QPainter painter(&image);
+					LabelPlacer placer(font, &image, 50);
+					for (const Contour& contour : contours)
+					{
+						DrawOperations::drawContourValues(painter, contour, QColor(Qt::black), placer);
+					}
+				});
+
+			std::printf("%6d %10zu %10zu %12.1f %12.1f %8.2f\n", size, contours.size(), labelCount, timeClip, timeSplit, timeClip / timeSplit);
+		}
+		std::printf("\n");
+	}
+
+	// One row of the stage table, kept for the JSON report
+	void reportStage(QJsonArray& results, const char* stage, int size, double ms, size_t contours)
+	{
+		double seconds = ms / 1000;
+		double pixels = double(size) * size;
+		double pixelsPerSecond = pixels / seconds;
+		double contoursPerSecond = contours / seconds;
+		std::printf("%6d %-22s %10.2f %12.2f %14.0f %10zu\n", size, stage, ms, pixelsPerSecond / 1e6, contoursPerSecond, contours);
+
+		QJsonObject result;
+		result["benchmark"] = "stages";
+		result["stage"] = stage;
+		result["size"] = size;
+		result["seed"] = QString::number(kSeed);
+		result["ms"] = ms;
+		result["pixelsPerSecond"] = pixelsPerSecond;
+		result["contours"] = static_cast<qint64>(contours);
+		result["contoursPerSecond"] = contoursPerSecond;
+		results.append(result);
+	}
+
+	// Every stage of generateImage on the output of the previous one, and the whole pipeline for both engines.
+	// The input of each size comes from the same seed, so runs are comparable between builds.
+	void benchStages(QJsonArray& results)
+	{
+		std::printf("stages\n");
+		std::printf("%6s %-22s %10s %12s %14s %10s\n", "size", "stage", "ms", "Mpx/s", "contours/s", "contours");
+
+		for (int size : { 256, 512, 1024, 2048, 4096 })
+		{
+			// best of a few runs, large sizes take long enough to be stable
+			const int repeats = size <= 512 ? 10 : size <= 1024 ? 5 : size <= 2048 ? 3 : 1;
+			GenerationParams params = benchParams(size);
+			WellParams wellParams{ 5, 10, 2, true, 0, QColor() };
+
+			cv::Mat isolines;
+			double timeIsolines = measure(repeats, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					isolines = ContoursOperations::generateIsolines(params, gen);
+				});
+
+			cv::Mat mask = cv::Scalar(255) - isolines;
+			cv::Mat thinned;
+			double timeThinning = measure(repeats, [&]()
+				{
+					cv::ximgproc::thinning(mask, thinned, cv::ximgproc::THINNING_GUOHALL);
+				});
+			thinned = thinned(cv::Rect(1, 1, thinned.cols - 2, thinned.rows - 2)).clone();
+
+			std::vector<Contour> contours;
+			double timeTracing = measure(repeats, [&]()
+				{
+					contours.clear();
+					ContoursOperations::findContours(thinned, contours);
+				});
+
+			cv::Mat labels;
+			double timeDepth = measure(repeats, [&]()
+				{
+					labels = ContoursOperations::labelContours(contours, thinned.size());
+					ContoursOperations::findDepth(labels, contours);
+				});
+
+			cv::Mat lines = cv::Mat::zeros(thinned.size(), CV_8UC3);
+			lines.setTo(cv::Scalar(75, 75, 75), labels != 0);
+			cv::Mat drawing;
+			double timeFill = measure(repeats, [&]()
+				{
+					drawing = lines.clone();
+					ContoursOperations::fillContours(labels, contours, drawing);
+				});
+
+			cv::Mat inpaintMask = labels != 0;
+			cv::Mat filled;
+			double timeInpaint = measure(repeats, [&]()
+				{
+					filled = drawing.clone();
+					ContoursOperations::fillFromNeighbours(filled, inpaintMask);
+				});
+
+			cv::Mat canvas;
+			double timeLabels = measure(repeats, [&]()
+				{
+					canvas = filled.clone();
+					QImage view = utils::matView(canvas);
+					QPainter painter(&view);
+					LabelPlacer placer(QFont(), &view, params.textDistance);
+					for (const Contour& contour : contours)
+					{
+						DrawOperations::drawContourValues(painter, contour, QColor(Qt::black), placer);
+					}
+				});
+
+			std::vector<uchar> buffer;
+			double timeEncode = measure(repeats, [&]()
+				{
+					EncodeOperations::encodeImage(canvas, OutputFormat(), buffer);
+				});
+
+			double timeRaster = measure(repeats, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					ImageGenerator::generateImage(params, wellParams, gen);
+				});
+
+			// the marching squares engine gives its own contours
+			GenerationParams marchingParams = params;
+			marchingParams.engine = ContourEngine::MARCHING_SQUARES;
+			size_t marchingContours = 0;
+			{
+				RandomGenerator gen(kSeed);
+				marchingContours = ContoursOperations::traceIsolines(ContoursOperations::generateField(marchingParams, gen), 1.0).size();
+			}
+			double timeMarching = measure(repeats, [&]()
+				{
+					RandomGenerator gen(kSeed);
+					ImageGenerator::generateImage(marchingParams, wellParams, gen);
+				});
+
+			const size_t count = contours.size();
+			reportStage(results, "isolines", size, timeIsolines, count);
+			reportStage(results, "thinning", size, timeThinning, count);
+			reportStage(results, "findContours", size, timeTracing, count);
+			reportStage(results, "findDepth", size, timeDepth, count);
+			reportStage(results, "fillContours", size, timeFill, count);
+			reportStage(results, "inpaint", size, timeInpaint, count);
+			reportStage(results, "labels", size, timeLabels, count);
+			reportStage(results, "encode", size, timeEncode, count);
+			reportStage(results, "generateImage raster", size, timeRaster, count);
+			reportStage(results, "generateImage marching", size, timeMarching, marchingContours);
+		}
+		std::printf("\n");
+	}
+
+	struct Benchmark
+	{
+		const char* name;
+		std::function<void()> run;
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+	{
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+	QGuiApplication app(argc, argv);
+
+	QJsonArray results;
+	std::vector<Benchmark> benchmarks = {
+		{ "field", benchFieldPrecision },
+		{ "octaves", benchOctaves },
+		{ "tracer", benchTracer },
+		{ "inpaint", benchInpaint },
+		{ "labels", benchLabels },
+		{ "stages", [&results]() { benchStages(results); } },
+	};
+
+	// benchmarks can be selected by name, all of them run by default; --json <file> writes the stage results
+	std::vector<const char*> names;
+	const char* jsonPath = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+		{
+			jsonPath = argv[++i];
+		}
+		else
+		{
+			names.push_back(argv[i]);
+		}
+	}
+
+	for (const auto& benchmark : benchmarks)
+	{
+		bool selected = names.empty();
+		for (const char* name : names)
+		{
+			selected |= std::strcmp(name, benchmark.name) == 0;
+		}
+		if (selected)
+		{
+			benchmark.run();
+		}
+	}
+
+	if (jsonPath)
+	{
+		QJsonObject report;
+		report["seed"] = QString::number(kSeed);
+		report["results"] = results;
+		QFile file(QString::fromLocal8Bit(jsonPath));
+		if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(report).toJson()) < 0)
+		{
+			std::fprintf(stderr, "Cannot write %s\n", jsonPath);
+			return 1;
+		}
+	}
+
+	return 0;
+}
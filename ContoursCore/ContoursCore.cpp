@@ -0,0 +1,86 @@
+#include "ContoursCore.h"
+#include "RandomGenerator.h"
+#include <QtGui/QGuiApplication>
+#include <mutex>
+
+void ContoursCore::ensureApplication()
+{
+	static std::once_flag created;
+	std::call_once(created, []()
+		{
+			if (QCoreApplication::instance())
+			{
+				return;
+			}
+			if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+			{
+				qputenv("QT_QPA_PLATFORM", "offscreen");
+			}
+
+			// arguments must outlive the application, which lives until the process exits
+			static int argc = 1;
+			static char name[] = "ContoursCore";
+			static char* argv[] = { name, nullptr };
+			new QGuiApplication(argc, argv);
+		});
+}
+
+GenerationParams ContoursCore::defaultParams()
+{
+	GenerationParams params{};
+	params.width = 1024;
+	params.height = 1024;
+	params.Xmul = 0.005;
+	params.Ymul = 0.005;
+	params.mul = 20;
+	params.generateWells = true;
+	params.numOfWells = 10;
+	params.generateIsolines = true;
+	params.fillContours = true;
+	params.drawValues = true;
+	params.textDistance = 50;
+	params.octaves = 4;
+	params.persistence = 0.5;
+	return params;
+}
+
+WellParams ContoursCore::defaultWellParams()
+{
+	WellParams params{};
+	params.radius = 5;
+	params.fontSize = 10;
+	params.offset = 2;
+	params.drawText = true;
+	params.outline = 0;
+	return params;
+}
+
+ContoursCore::SampleGenerator::SampleGenerator(const GenerationParams& params, const WellParams& wellParams, uint64_t baseSeed) :
+	m_params(params)
+	, m_wellParams(wellParams)
+	, m_baseSeed(baseSeed)
+{
+}
+
+GenImg ContoursCore::SampleGenerator::generate(uint64_t index, SampleStats* stats) const
+{
+	ensureApplication();
+
+	RandomGenerator gen = RandomGenerator::forSample(m_baseSeed, index);
+	return ImageGenerator::generateImage(m_params, m_wellParams, gen, nullptr, stats);
+}
+
+const GenerationParams& ContoursCore::SampleGenerator::params() const
+{
+	return m_params;
+}
+
+const WellParams& ContoursCore::SampleGenerator::wellParams() const
+{
+	return m_wellParams;
+}
+
+uint64_t ContoursCore::SampleGenerator::baseSeed() const
+{
+	return m_baseSeed;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "ImageGenerator.h"
+
+struct SampleStats;
+
+// Entry point for embedding the generation pipeline in other processes, e.g. the Python module.
+// The library uses QtGui only: samples are painted on QImage views of their cv::Mat buffers, no widget
+// or pixmap is involved, so it runs under the offscreen platform and on worker threads.
+namespace ContoursCore
+{
+    // Creates a QGuiApplication on the offscreen platform unless the process already has a Qt application,
+    // fonts need one. Should be called first from the main thread, later calls return immediately.
+    void ensureApplication();
+
+    // Defaults match the initial state of the GUI controls
+    GenerationParams defaultParams();
+    WellParams defaultWellParams();
+
+    // Generates single samples in memory, nothing is encoded or written.
+    // Sample index is reproducible from (baseSeed, index) like sample index of a BatchGenerator, on any thread.
+    class SampleGenerator
+    {
+    public:
+        SampleGenerator(const GenerationParams& params, const WellParams& wellParams, uint64_t baseSeed);
+
+        // Image CV_8UC3 (BGR) and mask CV_8UC1, both continuous and owned by the returned GenImg
+        GenImg generate(uint64_t index, SampleStats* stats = nullptr) const;
+
+        const GenerationParams& params() const;
+        const WellParams& wellParams() const;
+        uint64_t baseSeed() const;
+
+    private:
+        GenerationParams m_params;
+        WellParams m_wellParams;
+        uint64_t m_baseSeed;
+    };
+}
@@ -0,0 +1,206 @@
+#include "BatchGenerator.h"
+#include "RandomGenerator.h"
+#include "DatasetWriter.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+BatchGenerator::BatchGenerator(const GenerationParams& params, const WellParams& wellParams, const QString& folderPath, bool split, uint64_t baseSeed,
+	const OutputFormat& format) :
+	m_params(params)
+	, m_wellParams(wellParams)
+	, m_folderPath(folderPath)
+	, m_format(format)
+	, m_split(split)
+	, m_baseSeed(baseSeed)
+{
+}
+
+void BatchGenerator::run(int count, int numWorkers)
+{
+	m_completed = 0;
+	m_failed = 0;
+	m_stats.clear();
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (numWorkers <= 0)
+	{
+		numWorkers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	numWorkers = std::max(1, std::min(numWorkers, count));
+
+	m_nextIndex = 0;
+	m_queue.clear();
+	// two samples per worker are enough to hide the saving latency
+	m_queueCapacity = 2 * numWorkers;
+	m_activeWorkers = numWorkers;
+	m_stats.assign(m_collectStats ? count : 0, SampleStats());
+
+	// one folder scan for the whole batch, encoding and writing run in the background
+	DatasetWriter writer(m_folderPath, m_format);
+	// samples finish out of order, their files must not
+	m_tilesPerSample = m_split ? DatasetWriter::splitCount(cv::Size(m_params.width, m_params.height)) : 1;
+	m_firstIndex = writer.reserve(count * m_tilesPerSample);
+
+	std::vector<std::thread> workers;
+	workers.reserve(numWorkers);
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		workers.emplace_back(&BatchGenerator::workerLoop, this, count);
+	}
+
+	while (true)
+	{
+		std::pair<int, GenImg> sample;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_notEmpty.wait(lock, [this] { return !m_queue.empty() || m_activeWorkers == 0; });
+			if (m_queue.empty())
+			{
+				break;
+			}
+			sample = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+		m_notFull.notify_one();
+
+		if (!m_canceled)
+		{
+			save(writer, m_firstIndex + sample.first * m_tilesPerSample, sample.second, m_collectStats ? &m_stats[sample.first] : nullptr);
+			int done = ++m_completed;
+			if (m_progressCallback)
+			{
+				m_progressCallback(done);
+			}
+		}
+	}
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	writer.finish();
+	m_failed = writer.failed();
+
+	if (m_collectStats)
+	{
+		writeStats();
+	}
+}
+
+void BatchGenerator::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_canceled = true;
+	}
+	m_notFull.notify_all();
+}
+
+int BatchGenerator::completed() const
+{
+	return m_completed;
+}
+
+int BatchGenerator::failed() const
+{
+	return m_failed;
+}
+
+void BatchGenerator::setCollectStats(bool collect)
+{
+	m_collectStats = collect;
+}
+
+SampleStats BatchGenerator::totalStats() const
+{
+	SampleStats total;
+	for (const auto& stats : m_stats)
+	{
+		total.add(stats);
+	}
+	return total;
+}
+
+void BatchGenerator::setProgressCallback(std::function<void(int)> callback)
+{
+	m_progressCallback = std::move(callback);
+}
+
+void BatchGenerator::workerLoop(int count)
+{
+#ifdef _OPENMP
+	// every worker runs the whole pipeline, nested OpenMP teams would only oversubscribe the cores
+	omp_set_num_threads(1);
+#endif
+
+	while (!m_canceled)
+	{
+		int index = m_nextIndex++;
+		if (index >= count)
+		{
+			break;
+		}
+
+		RandomGenerator random = RandomGenerator::forSample(m_baseSeed, index);
+		// every sample has its own entry, workers never share one
+		SampleStats* stats = m_collectStats ? &m_stats[index] : nullptr;
+		GenImg gen = ImageGenerator::generateImage(m_params, m_wellParams, random, &m_canceled, stats);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_queue.size() < m_queueCapacity || m_canceled; });
+		if (m_canceled)
+		{
+			break;
+		}
+		m_queue.emplace_back(index, std::move(gen));
+		lock.unlock();
+		m_notEmpty.notify_one();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		--m_activeWorkers;
+	}
+	m_notEmpty.notify_one();
+}
+
+void BatchGenerator::save(DatasetWriter& writer, int firstIndex, const GenImg& gen, SampleStats* stats)
+{
+	if (m_split)
+	{
+		writer.writeSplit(firstIndex, gen, 256, stats);
+	}
+	else
+	{
+		writer.write(firstIndex, gen.image, gen.mask, stats);
+	}
+}
+
+void BatchGenerator::writeStats() const
+{
+	QFile file(m_folderPath + "/stats.csv");
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+	{
+		return;
+	}
+
+	// canceled samples keep empty rows, the seed still identifies them
+	// file is the index of the image and mask files of the sample, of its first tile when split
+	QTextStream out(&file);
+	out << "sample,file,seed," << SampleStats::csvHeader() << "\n";
+	for (size_t i = 0; i < m_stats.size(); ++i)
+	{
+		int fileIndex = m_firstIndex + static_cast<int>(i) * m_tilesPerSample;
+		out << QString::number(i) << "," << QString::number(fileIndex) << "," << QString::number(RandomGenerator::forSample(m_baseSeed, i).seed()) << ","
+			<< m_stats[i].csvRow() << "\n";
+	}
+	out << "total,,," << totalStats().csvRow() << "\n";
+}
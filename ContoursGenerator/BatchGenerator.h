@@ -0,0 +1,74 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "ImageGenerator.h"
+#include "EncodeOperations.h"
+#include "SampleStats.h"
+
+class DatasetWriter;
+
+// Generates a batch of samples with several independent pipelines running in parallel.
+// Workers push finished samples into a bounded queue which is drained by the thread calling run() into a DatasetWriter,
+// so memory stays bounded when saving is slower than generation.
+class BatchGenerator
+{
+public:
+    // Sample i is generated from RandomGenerator::forSample(baseSeed, i) regardless of the worker running it
+    BatchGenerator(const GenerationParams& params, const WellParams& wellParams, const QString& folderPath, bool split, uint64_t baseSeed,
+        const OutputFormat& format = OutputFormat());
+
+    // Blocks until all samples are saved or the batch is canceled. numWorkers <= 0 uses all cores.
+    // The file indices are reserved up front, sample i is saved at the i-th slot no matter when it finishes.
+    void run(int count, int numWorkers);
+    // Can be called from any thread
+    void cancel();
+
+    int completed() const;
+    // Images or tiles the writer could not save in the last run()
+    int failed() const;
+    // Per-stage times and counters of every sample, written to stats.csv in the output folder after run()
+    void setCollectStats(bool collect);
+    // Sums over the samples of the last run(), empty without setCollectStats(true)
+    SampleStats totalStats() const;
+    // Called from the run() thread after every sample handed to the writer
+    void setProgressCallback(std::function<void(int)> callback);
+
+protected:
+    void workerLoop(int count);
+    // Writes the sample at the indices from firstIndex on, one per tile when split
+    void save(DatasetWriter& writer, int firstIndex, const GenImg& gen, SampleStats* stats);
+    void writeStats() const;
+
+private:
+    GenerationParams m_params;
+    WellParams m_wellParams;
+    QString m_folderPath;
+    OutputFormat m_format;
+    bool m_split;
+    uint64_t m_baseSeed;
+    std::function<void(int)> m_progressCallback;
+    bool m_collectStats = false;
+    std::vector<SampleStats> m_stats; // indexed by sample
+    int m_firstIndex = 0; // file index of sample 0 in the last run()
+    int m_tilesPerSample = 1;
+
+    std::atomic<int> m_nextIndex{ 0 };
+    std::atomic<int> m_completed{ 0 };
+    int m_failed = 0;
+    std::atomic<bool> m_canceled{ false };
+
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<std::pair<int, GenImg>> m_queue; // sample index, sample
+    size_t m_queueCapacity = 1;
+    int m_activeWorkers = 0;
+};
@@ -1,12 +1,29 @@
 #include "ContoursGenerator.h"
 #include "DrawOperations.h"
-#include <qfile.h>
 #include <qfiledialog.h>
-#include <opencv2/ximgproc.hpp>
 #include "ContoursOperations.h"
-#include <qpainter.h>
+#include "DatasetWriter.h"
+#include "BatchGenerator.h"
+#include "SampleStats.h"
 #include <QProgressDialog>
+#include <QEventLoop>
+#include <QPixmap>
+#include <QFutureWatcher>
+#include <QMessageBox>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrent>
 #include <RandomGenerator.h>
+#include <climits>
+
+namespace
+{
+	// deep copy for display, pixmaps are created only by the GUI
+	QPixmap toPixmap(const cv::Mat& mat)
+	{
+		return QPixmap::fromImage(utils::matView(mat));
+	}
+}
 
 ContoursGenerator::ContoursGenerator(QWidget* parent)
 	: QMainWindow(parent)
@@ -14,38 +31,84 @@ ContoursGenerator::ContoursGenerator(QWidget* parent)
 {
 	ui->setupUi(this);
 	this->setWindowIcon(QIcon("iso.ico"));
+	ui->spinBox_Threads->setValue(QThread::idealThreadCount());
 
 	initConnections();
 }
 
 ContoursGenerator::~ContoursGenerator()
 {
+	cancelGeneration();
 }
 
 void ContoursGenerator::OnGenerateImage()
 {
-	GenImg genImg = generateImage();
-	m_generatedImage = genImg.image;
-	m_generatedMask = genImg.mask;
+	// a new request makes the running one useless
+	cancelGeneration();
+	m_cancelGeneration = std::make_shared<std::atomic<bool>>(false);
+	quint64 generation = ++m_generation;
+
+	// parameters are read here, the worker does not touch the widgets
+	GenerationParams params = getUIParams();
+	WellParams wellParams = getUIWellParams();
+	uint64_t seed = nextSeed();
+	std::shared_ptr<std::atomic<bool>> canceled = m_cancelGeneration;
+
+	statusBar()->showMessage(tr("Generating..."));
+
+	// the worker fills the stats, the watcher reads them after it finished
+	auto stats = std::make_shared<SampleStats>();
+
+	auto* watcher = new QFutureWatcher<GenImg>(this);
+	connect(watcher, &QFutureWatcher<GenImg>::finished, this, [this, watcher, generation, stats]()
+		{
+			watcher->deleteLater();
+			if (generation != m_generation)
+			{
+				return;
+			}
+
+			GenImg result = watcher->result();
+			if (result.image.empty())
+			{
+				statusBar()->clearMessage();
+			}
+			else
+			{
+				statusBar()->showMessage(stats->summary());
+				m_generated = result;
+				OnUpdateImage();
+			}
+		});
 
-	OnUpdateImage();
+	watcher->setFuture(QtConcurrent::run([params, wellParams, seed, canceled, stats]()
+		{
+			// same stream as the first sample of a batch with this seed
+			RandomGenerator gen = RandomGenerator::forSample(seed, 0);
+			return ImageGenerator::generateImage(params, wellParams, gen, canceled.get(), stats.get());
+		}));
 }
 
 void ContoursGenerator::OnUpdateImage()
 {
+	if (m_generated.image.empty())
+	{
+		return;
+	}
+
 	if (ui->checkBox_ShowMask->isChecked())
 	{
-		ui->label_Image->setPixmap(m_generatedMask);
+		ui->label_Image->setPixmap(toPixmap(m_generated.mask));
 	}
 	else
 	{
-		ui->label_Image->setPixmap(m_generatedImage);
+		ui->label_Image->setPixmap(toPixmap(m_generated.image));
 	}
 }
 
 void ContoursGenerator::OnSaveImage()
 {
-	if (m_generatedImage.isNull() || m_generatedMask.isNull())
+	if (m_generated.image.empty() || m_generated.mask.empty())
 	{
 		return;
 	}
@@ -56,7 +119,9 @@ void ContoursGenerator::OnSaveImage()
 		return;
 	}
 
-	saveImage(folderName, m_generatedImage, m_generatedMask);
+	DatasetWriter& writer = sessionWriter(folderName, getUIOutputFormat());
+	writer.write(m_generated.image, m_generated.mask);
+	writer.finish();
 }
 
 void ContoursGenerator::OnSaveBatch()
@@ -67,23 +132,50 @@ void ContoursGenerator::OnSaveBatch()
 		return;
 	}
 
+	int batchSize = ui->spinBox_BatchSize->value();
+	int numThreads = ui->spinBox_Threads->value();
+
 	// show progress dialog
-	QProgressDialog progress("Generating images...", "Abort", 0, ui->spinBox_BatchSize->value(), this);
+	QProgressDialog progress("Generating images...", "Abort", 0, batchSize, this);
 	progress.setWindowModality(Qt::WindowModal);
 	progress.setWindowFlags(progress.windowFlags() & ~Qt::WindowContextHelpButtonHint);
 
-	int batchSize = ui->spinBox_BatchSize->value();
-	for (int i = 0; i < batchSize; ++i)
+	BatchGenerator batch(getUIParams(), getUIWellParams(), folderName, true, nextSeed(), getUIOutputFormat());
+
+	// generation runs on worker threads, keep the event loop alive to update the progress
+	QEventLoop loop;
+	QFutureWatcher<void> watcher;
+	connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+	connect(&progress, &QProgressDialog::canceled, [&batch]() { batch.cancel(); });
+
+	QTimer timer;
+	connect(&timer, &QTimer::timeout, [&]() { progress.setValue(batch.completed()); });
+	timer.start(100);
+
+	watcher.setFuture(QtConcurrent::run([&batch, batchSize, numThreads]() { batch.run(batchSize, numThreads); }));
+	loop.exec();
+
+	timer.stop();
+	progress.setValue(batchSize);
+	// the batch numbered its files with a writer of its own, the session writer would reuse their indices
+	m_writer.reset();
+
+	if (batch.failed() > 0)
 	{
-		if(progress.wasCanceled())
-		{
-			break;
-		}
-		GenImg generation = generateImage();
-		saveImageSplit(folderName, generation);
-		progress.setValue(i);
+		QMessageBox::warning(this, "Generate batch", QString("Failed to save %1 tiles to %2").arg(batch.failed()).arg(folderName));
 	}
-	progress.setValue(batchSize);
+}
+
+DatasetWriter& ContoursGenerator::sessionWriter(const QString& folderPath, const OutputFormat& format)
+{
+	if (!m_writer || folderPath != m_writerFolder || format != m_writerFormat)
+	{
+		m_writer.reset();
+		m_writer = std::make_unique<DatasetWriter>(folderPath, format, 1);
+		m_writerFolder = folderPath;
+		m_writerFormat = format;
+	}
+	return *m_writer;
 }
 
 void ContoursGenerator::initConnections()
@@ -98,186 +190,21 @@ void ContoursGenerator::initConnections()
 	connect(ui->pushButton_GenerateBatch, &QPushButton::pressed, this, &ContoursGenerator::OnSaveBatch);
 }
 
-GenImg ContoursGenerator::generateImage()
-{
-	GenerationParams params = getUIParams();
-
-	cv::Mat isolines; // isolines mat
-	cv::Mat mask; // mask mat
-	QPixmap pixIso; // visual representation pixmap
-
-	int cropSize = 1;
-
-	if (params.generateIsolines)
-	{
-		isolines = ContoursOperations::generateIsolines(params);
-
-		mask = cv::Scalar(255) - isolines;
-
-		// apply thinning
-		cv::Mat thinned;
-		cv::ximgproc::thinning(mask, thinned, cv::ximgproc::THINNING_GUOHALL);
-
-		// crop by 1 pixel
-		cv::Rect cropRect(cropSize, cropSize, thinned.cols - 2 * cropSize, thinned.rows - 2 * cropSize);
-		thinned = thinned(cropRect);
-
-		std::vector<Contour> contours;
-
-		// Find contours
-		ContoursOperations::findContours(thinned, contours);
-
-		cv::Mat contours_mat = cv::Mat::zeros(thinned.size(), CV_8UC1);
-		for (size_t i = 0; i < contours.size(); i++)
-		{
-			const Contour& c = contours[i];
-			cv::Scalar color = cv::Scalar(255, 255, 255);
-			for (size_t j = 0; j < c.points.size(); ++j)
-			{
-				contours_mat.at<uchar>(c.points[j]) = c.value;
-			}
-		}
-
-		// Find depth
-		ContoursOperations::findDepth(contours_mat, contours);
-
-		// Depth mat
-		cv::Mat depthMat = cv::Mat::zeros(thinned.size(), CV_8UC1);
-		for (size_t i = 0; i < contours.size(); i++)
-		{
-			const Contour& c = contours[i];
-			for (size_t j = 0; j < c.points.size(); ++j)
-			{
-				depthMat.at<uchar>(c.points[j]) = c.depth + 1;
-			}
-		}
-
-		// Draw contours
-		cv::Mat drawing = params.fillContours ? cv::Mat::zeros(thinned.size(), CV_8UC3) : cv::Mat(thinned.size(), CV_8UC3, cv::Scalar(255, 255, 255));
-		for (size_t i = 0; i < contours.size(); i++)
-		{
-			for (size_t j = 0; j < contours[i].points.size(); ++j)
-			{
-				cv::Scalar color = contours[i].isClosed ? cv::Scalar(75, 75, 75) : cv::Scalar(150, 100, 150);
-				drawing.at<cv::Vec3b>(contours[i].points[j]) = cv::Vec3b(color[0], color[1], color[2]);
-			}
-		}
-
-		if (params.fillContours)
-		{
-			// Fill areas
-			ContoursOperations::fillContours(contours_mat, contours, drawing);
-		}
-
-		// Inpaint contours on drawing
-		cv::Mat maskInpaint = cv::Mat::zeros(thinned.size(), CV_8UC1);
-		for (size_t i = 0; i < contours.size(); i++)
-		{
-			const Contour& c = contours[i];
-			for (size_t j = 0; j < c.points.size(); ++j)
-			{
-				maskInpaint.at<uchar>(c.points[j]) = 255;
-			}
-		}
-
-		// Inpaint
-		cv::inpaint(drawing, maskInpaint, drawing, 3, cv::INPAINT_TELEA);
-
-		pixIso = utils::cvMat2Pixmap(drawing);
-
-		// Draw contours 
-		QFont font;
-		QPainter painter(&pixIso);
-
-		for (const auto& contour : contours)
-		{
-			if (params.drawValues)
-			{
-				DrawOperations::drawContourValues(painter, contour, QColor(Qt::black), font, params.textDistance);
-			}
-			else
-			{
-				DrawOperations::drawContour(painter, contour, QColor(Qt::black));
-			}
-		}
-	}
-	else
-	{
-		isolines = cv::Mat::zeros(params.height, params.width, CV_8UC1);
-		mask = isolines.clone();
-		pixIso = utils::cvMat2Pixmap(isolines);
-	}
-
-	if (params.generateWells)
-	{
-		WellParams wellParams = getUIWellParams();
-		for (int i = 0; i < params.numOfWells; ++i)
-		{
-			DrawOperations::drawRandomWell(pixIso, wellParams);
-		}
-	}
-
-	QPixmap pixMask = utils::cvMat2Pixmap(mask);
-
-	// inpaint cropped pixels
-	cv::Mat pixIsoUncropped = utils::QPixmap2cvMat(pixIso, false);
-	cv::Mat maskUncropped = cv::Mat::zeros(pixIsoUncropped.size(), CV_8UC1);
-	// enlarge by 1 pixel
-	cv::copyMakeBorder(pixIsoUncropped, pixIsoUncropped, cropSize, cropSize, cropSize, cropSize, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
-	cv::copyMakeBorder(maskUncropped, maskUncropped, cropSize, cropSize, cropSize, cropSize, cv::BORDER_CONSTANT, cv::Scalar(255));
-	cv::inpaint(pixIsoUncropped, maskUncropped, pixIsoUncropped, 3, cv::INPAINT_TELEA);
-	
-	QPixmap pixIsoResult = utils::cvMat2Pixmap(pixIsoUncropped);
-
-	GenImg result{ pixIsoResult, pixMask };
-	return result;
-}
-
-void ContoursGenerator::saveImageSplit(const QString& folderPath, const GenImg& gen)
+void ContoursGenerator::cancelGeneration()
 {
-	int baseSize = 256;
-	int width = gen.image.width();
-	int height = gen.image.height();
-	int numX = width / baseSize;
-	int numY = height / baseSize;
-
-	for (int i = 0; i < numX; ++i)
+	if (m_cancelGeneration)
 	{
-		for (int j = 0; j < numY; ++j)
-		{
-			QRect rect(i * baseSize, j * baseSize, baseSize, baseSize);
-			QPixmap img = gen.image.copy(rect);
-			QPixmap mask = gen.mask.copy(rect);
-			saveImage(folderPath, img, mask);
-		}
+		*m_cancelGeneration = true;
 	}
 }
 
-void ContoursGenerator::saveImage(const QString& folderPath, const QPixmap& img, const QPixmap& mask)
+uint64_t ContoursGenerator::nextSeed()
 {
-	QDir().mkpath(folderPath + "/images");
-	QDir().mkpath(folderPath + "/masks");
-
-	QString baseName;
-	int index = 0;
-	QString imageFileName, maskFileName;
-	do
-	{
-		baseName = QString::number(index);
-		imageFileName = folderPath + "/images/" + baseName + ".jpg";
-		maskFileName = folderPath + "/masks/" + baseName + ".jpg";
-		index++;
-	} while (QFile::exists(imageFileName) || QFile::exists(maskFileName));
-
-	if (!img.save(imageFileName, "JPG"))
-	{
-		return;
-	}
-	if (!mask.save(maskFileName, "JPG"))
+	if (ui->checkBox_RandomSeed->isChecked())
 	{
-		QFile::remove(imageFileName);
-		return;
+		ui->spinBox_Seed->setValue(RandomGenerator::randomSeed() & INT_MAX);
 	}
+	return ui->spinBox_Seed->value();
 }
 
 GenerationParams ContoursGenerator::getUIParams()
@@ -296,6 +223,13 @@ GenerationParams ContoursGenerator::getUIParams()
 		params.fillContours = ui->checkBox_Fill->isChecked();
 		params.drawValues = ui->groupBox_DrawValues->isChecked();
 		params.textDistance = ui->spinBox_TextDistance->value();
+		params.singlePrecision = ui->checkBox_SinglePrecision->isChecked();
+		params.engine = ui->comboBox_Engine->currentIndex() == 1 ? ContourEngine::MARCHING_SQUARES : ContourEngine::RASTER;
+		params.inpaintTelea = ui->checkBox_Telea->isChecked();
+		const NoiseMode noiseModes[] = { NoiseMode::SINGLE, NoiseMode::FBM, NoiseMode::RIDGED };
+		params.noiseMode = noiseModes[ui->comboBox_Noise->currentIndex()];
+		params.octaves = ui->spinBox_Octaves->value();
+		params.persistence = ui->doubleSpinBox_Persistence->value();
 	}
 	return params;
 }
@@ -312,39 +246,19 @@ WellParams ContoursGenerator::getUIWellParams()
 		params.outline = ui->spinBox_WellOutline->value();
 	}
 
-	params.color = RandomGenerator::instance().getRandomColor();
-
 	return params;
 }
 
-QPixmap utils::cvMat2Pixmap(const cv::Mat& input)
+OutputFormat ContoursGenerator::getUIOutputFormat()
 {
-	QImage image;
-	if (input.channels() == 3)
-	{
-		image = QImage((uchar*)input.data, input.cols, input.rows, input.step, QImage::Format_BGR888);
-	}
-	else if (input.channels() == 1)
-	{
-		image = QImage((uchar*)input.data, input.cols, input.rows, input.step, QImage::Format_Grayscale8);
-	}
-	QPixmap cpy = QPixmap::fromImage(image);
-	return cpy;
-}
-
-cv::Mat utils::QPixmap2cvMat(const QPixmap& in, bool grayscale)
-{
-	QImage im = in.toImage();
-	if (grayscale)
-	{
-		im.convertTo(QImage::Format_Grayscale8);
-		return cv::Mat(im.height(), im.width(), CV_8UC1, const_cast<uchar*>(im.bits()), im.bytesPerLine()).clone();
-	}
-	else
+	OutputFormat format;
+	if (ui)
 	{
-		im.convertTo(QImage::Format_BGR888);
-		return cv::Mat(im.height(), im.width(), CV_8UC3, const_cast<uchar*>(im.bits()), im.bytesPerLine()).clone();
+		const MaskCodec maskCodecs[] = { MaskCodec::JPEG, MaskCodec::PNG, MaskCodec::PNG_1BIT, MaskCodec::NPY };
+		format.maskCodec = maskCodecs[ui->comboBox_MaskFormat->currentIndex()];
+		format.jpegQuality = ui->spinBox_JpegQuality->value();
 	}
+	return format;
 }
 
 template<int size>
@@ -353,30 +267,3 @@ inline void ContoursGenerator::setSize()
 	ui->spinBox_Height->setValue(size);
 	ui->spinBox_Width->setValue(size);
 }
-
-ColorScaler::ColorScaler(double min, double max, const cv::Scalar& minColor, const cv::Scalar& maxColor) :
-	m_min(min)
-	, m_max(max)
-	, m_minColor(minColor)
-	, m_maxColor(maxColor)
-{
-}
-
-cv::Scalar ColorScaler::getColor(double value) const
-{
-	if (value < m_min)
-	{
-		return m_minColor;
-	}
-	if (value > m_max)
-	{
-		return m_maxColor;
-	}
-	double ratio = (value - m_min) / (m_max - m_min);
-	cv::Scalar color;
-	for (int i = 0; i < 3; ++i)
-	{
-		color[i] = m_minColor[i] + ratio * (m_maxColor[i] - m_minColor[i]);
-	}
-	return color;
-}
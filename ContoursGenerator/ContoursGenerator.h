@@ -2,7 +2,10 @@
 
 #include <QtWidgets/QMainWindow>
 #include "ui_ContoursGenerator.h"
-#include "opencv2/opencv.hpp"
+#include "ImageGenerator.h"
+#include "EncodeOperations.h"
+#include <atomic>
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class ContoursGeneratorClass; };
@@ -10,18 +13,7 @@ QT_END_NAMESPACE
 
 struct WellParams;
 struct GenerationParams;
-
-struct GenImg
-{
-    QPixmap image;
-    QPixmap mask;
-};
-
-namespace utils
-{
-    QPixmap cvMat2Pixmap(const cv::Mat& input);
-    cv::Mat QPixmap2cvMat(const QPixmap& in, bool grayscale);
-}
+class DatasetWriter;
 
 class ContoursGenerator : public QMainWindow
 {
@@ -39,18 +31,24 @@ protected slots:
 
 protected:
     void initConnections();
-    GenImg generateImage();
+    void cancelGeneration();
+    uint64_t nextSeed(); // seed from the UI, or a new random one shown in the UI
 
-    void saveImageSplit(const QString& folderPath, const GenImg& gen);
-    void saveImage(const QString& folderPath, const QPixmap& img, const QPixmap& mask);
     GenerationParams getUIParams();
     WellParams getUIWellParams();
+    OutputFormat getUIOutputFormat();
+    // Writer of the session, the folder is scanned once and again only when the folder or the format changes
+    DatasetWriter& sessionWriter(const QString& folderPath, const OutputFormat& format);
 
     template<int size> 
     void setSize(); // set image size
 
 private:
     std::unique_ptr<Ui::ContoursGeneratorClass> ui;
-    QPixmap m_generatedImage;
-    QPixmap m_generatedMask;
+    GenImg m_generated;
+    quint64 m_generation = 0; // id of the latest generate request, results of older requests are dropped
+    std::shared_ptr<std::atomic<bool>> m_cancelGeneration; // cancel flag of the running generate request
+    std::unique_ptr<DatasetWriter> m_writer;
+    QString m_writerFolder;
+    OutputFormat m_writerFormat;
 };
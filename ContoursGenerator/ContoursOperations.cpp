@@ -1,160 +1,560 @@
 #include "ContoursOperations.h"
-#include <stack>
 #include "PerlinNoise.hpp"
 #include "RandomGenerator.h"
+#include <numeric>
 
-cv::Mat ContoursOperations::generateIsolines(const GenerationParams& params)
+ColorScaler::ColorScaler(double min, double max, const cv::Scalar& minColor, const cv::Scalar& maxColor) :
+	m_min(min)
+	, m_max(max)
+	, m_minColor(minColor)
+	, m_maxColor(maxColor)
 {
-	const siv::PerlinNoise::seed_type seed = RandomGenerator::instance().getRandomInt(INT_MAX);
-	const siv::PerlinNoise perlin{ seed };
+}
+
+cv::Scalar ColorScaler::getColor(double value) const
+{
+	if (value < m_min)
+	{
+		return m_minColor;
+	}
+	if (value > m_max)
+	{
+		return m_maxColor;
+	}
+	double ratio = (value - m_min) / (m_max - m_min);
+	cv::Scalar color;
+	for (int i = 0; i < 3; ++i)
+	{
+		color[i] = m_minColor[i] + ratio * (m_maxColor[i] - m_minColor[i]);
+	}
+	return color;
+}
 
-	cv::Mat grad;
-	cv::Mat n(params.width, params.height, CV_64FC1);
+namespace
+{
+	// Noise field scaled by the total multiplier, evaluated in Float precision.
+	// region is a part of the params.width x params.height field (rows x cols), positions come from the whole field
+	template <class Float>
+	cv::Mat generateFieldImpl(const GenerationParams& params, siv::PerlinNoise::seed_type seed, const cv::Rect& region)
+	{
+		const siv::BasicPerlinNoise<Float> perlin{ seed };
 
-	double xMul = params.Xmul; // default: 0.005
-	double yMul = params.Ymul; // default: 0.005
-	int mul = params.mul; // default: 20
+		cv::Mat n(region.height, region.width, cv::DataType<Float>::depth);
+
+		Float xMul = static_cast<Float>(params.Xmul); // default: 0.005
+		Float yMul = static_cast<Float>(params.Ymul); // default: 0.005
+		Float mul = static_cast<Float>(params.mul); // default: 20
+		const std::int32_t octaves = std::max(1, params.octaves);
+		const Float persistence = static_cast<Float>(params.persistence);
 
 #pragma omp parallel for
-	for (int j = 0; j < n.rows; ++j)
-	{
-		for (int i = 0; i < n.cols; ++i)
+		for (int j = 0; j < n.rows; ++j)
 		{
-			double noise = perlin.noise2D_01(i * xMul, j * yMul) * mul;
-			int nnn = (int)ceil(noise);
-			noise = noise - floor(noise);
-			n.at<double>(j, i) = noise;
+			// whole row at once, same values as noise2D_01(i * xMul, j * yMul) or normalizedOctave2D_01() for FBM
+			Float* row = n.ptr<Float>(j);
+			const Float y = (region.y + j) * yMul;
+			switch (params.noiseMode)
+			{
+			case NoiseMode::FBM:
+				perlin.normalizedOctave2DRow_01(0, xMul, y, region.x, n.cols, octaves, persistence, row);
+				break;
+			case NoiseMode::RIDGED:
+				perlin.ridgedOctave2DRow_01(0, xMul, y, region.x, n.cols, octaves, persistence, row);
+				break;
+			default:
+				perlin.noise2DRow_01(0, xMul, y, region.x, n.cols, row);
+				break;
+			}
+			for (int i = 0; i < n.cols; ++i)
+			{
+				row[i] = row[i] * mul;
+			}
 		}
+
+		return n;
 	}
 
-	cv::Mat grad_x, grad_y;
-	cv::Mat abs_grad_x, abs_grad_y;
-	cv::Sobel(n, grad_x, CV_64FC1, 1, 0);
-	cv::Sobel(n, grad_y, CV_64FC1, 0, 1);
-	cv::convertScaleAbs(grad_x, abs_grad_x);
-	cv::convertScaleAbs(grad_y, abs_grad_y);
-	cv::addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, grad);
+	// Isolines mask of the fractional part of the field
+	template <class Float>
+	cv::Mat isolinesFromField(cv::Mat n)
+	{
+		const int depth = cv::DataType<Float>::depth;
 
-	cv::Mat normalized;
-	n.convertTo(normalized, CV_8UC1, 255, 0);
-	grad.forEach<uchar>([](uchar& u, const int* pos)
+#pragma omp parallel for
+		for (int j = 0; j < n.rows; ++j)
 		{
-			if (u == 1)
-				u = 0;
-			else if (u > 1)
+			Float* row = n.ptr<Float>(j);
+			for (int i = 0; i < n.cols; ++i)
 			{
-				u = 255;
+				Float noise = row[i];
+				noise = noise - std::floor(noise);
+				row[i] = noise;
 			}
-		});
-	cv::Mat gradInv = cv::Scalar(255) - grad;
+		}
 
-	return gradInv;
-}
+		cv::Mat grad;
+		cv::Mat grad_x, grad_y;
+		cv::Mat abs_grad_x, abs_grad_y;
+		cv::Sobel(n, grad_x, depth, 1, 0);
+		cv::Sobel(n, grad_y, depth, 0, 1);
+		cv::convertScaleAbs(grad_x, abs_grad_x);
+		cv::convertScaleAbs(grad_y, abs_grad_y);
+		cv::addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, grad);
 
-void ContoursOperations::findContours(const cv::Mat& img, std::vector<Contour>& contours)
-{
-	int width = img.cols;
-	int height = img.rows;
+		grad.forEach<uchar>([](uchar& u, const int* pos)
+			{
+				if (u == 1)
+					u = 0;
+				else if (u > 1)
+				{
+					u = 255;
+				}
+			});
+		cv::Mat gradInv = cv::Scalar(255) - grad;
 
-	cv::Mat mat = img.clone();
-	for (int m = 0; m < height; ++m)
+		return gradInv;
+	}
+
+	// Crossing of an isoline with a cell edge
+	struct IsoNode
 	{
-		for (int n = 0; n < width; ++n)
+		cv::Point2f pt;
+		int level;
+		int link[2];
+	};
+
+	// Marching squares over all levels k * step at once. Crossing nodes of the edges are shared
+	// between neighbouring cells, so polylines are stitched while the field is scanned row by row.
+	template <class Float>
+	std::vector<ContoursOperations::Isoline> traceIsolinesImpl(const cv::Mat& field, double step)
+	{
+		const int width = field.cols;
+		const int height = field.rows;
+
+		std::vector<IsoNode> nodes;
+
+		auto band = [step](Float v) { return static_cast<int>(std::floor(v / step)); };
+
+		// nodes of one edge are created consecutively for levels (lo, hi]
+		auto addNodes = [&](Float p, Float q, cv::Point2f a, cv::Point2f b) -> int
+			{
+				int bp = band(p);
+				int bq = band(q);
+				if (bp == bq)
+				{
+					return -1;
+				}
+				int first = static_cast<int>(nodes.size());
+				int lo = std::min(bp, bq);
+				int hi = std::max(bp, bq);
+				for (int k = lo + 1; k <= hi; ++k)
+				{
+					float t = static_cast<float>((k * step - p) / (q - p));
+					nodes.push_back({ a + (b - a) * t, k, { -1, -1 } });
+				}
+				return first;
+			};
+
+		// node of level k on an edge, if the edge is crossed by it
+		auto nodeAt = [&](int first, Float p, Float q, int k) -> int
+			{
+				return first + (k - std::min(band(p), band(q)) - 1);
+			};
+
+		auto link = [&](int a, int b)
+			{
+				nodes[a].link[nodes[a].link[0] == -1 ? 0 : 1] = b;
+				nodes[b].link[nodes[b].link[0] == -1 ? 0 : 1] = a;
+			};
+
+		// horizontal edges of the current and the next row, vertical edges of the current row
+		std::vector<int> hTop(std::max(width - 1, 0)), hBottom(std::max(width - 1, 0)), vRow(width);
+
+		auto makeHorizontal = [&](int y, std::vector<int>& edges)
+			{
+				const Float* row = field.ptr<Float>(y);
+				for (int x = 0; x + 1 < width; ++x)
+				{
+					edges[x] = addNodes(row[x], row[x + 1], cv::Point2f(x, y), cv::Point2f(x + 1, y));
+				}
+			};
+
+		if (height > 0)
+		{
+			makeHorizontal(0, hTop);
+		}
+
+		for (int y = 0; y + 1 < height; ++y)
 		{
-			if (mat.at<uchar>(m, n) == 255)
+			const Float* top = field.ptr<Float>(y);
+			const Float* bottom = field.ptr<Float>(y + 1);
+
+			makeHorizontal(y + 1, hBottom);
+			for (int x = 0; x < width; ++x)
 			{
-				Contour c;
-				extractContour(n, m, mat, c.points);
-				contours.push_back(std::move(c));
+				vRow[x] = addNodes(top[x], bottom[x], cv::Point2f(x, y), cv::Point2f(x, y + 1));
+			}
+
+			for (int x = 0; x + 1 < width; ++x)
+			{
+				// corners: a top-left, b top-right, c bottom-right, d bottom-left
+				Float a = top[x], b = top[x + 1], c = bottom[x + 1], d = bottom[x];
+				int ba = band(a), bb = band(b), bc = band(c), bd = band(d);
+				int lo = std::min(std::min(ba, bb), std::min(bc, bd));
+				int hi = std::max(std::max(ba, bb), std::max(bc, bd));
+
+				for (int k = lo + 1; k <= hi; ++k)
+				{
+					bool ia = ba >= k, ib = bb >= k, ic = bc >= k, id = bd >= k;
+
+					// edges: 0 top (a-b), 1 right (b-c), 2 bottom (d-c), 3 left (a-d)
+					int edge[4] = { -1, -1, -1, -1 };
+					if (ia != ib) edge[0] = nodeAt(hTop[x], a, b, k);
+					if (ib != ic) edge[1] = nodeAt(vRow[x + 1], b, c, k);
+					if (id != ic) edge[2] = nodeAt(hBottom[x], d, c, k);
+					if (ia != id) edge[3] = nodeAt(vRow[x], a, d, k);
+
+					int crossed = (edge[0] != -1) + (edge[1] != -1) + (edge[2] != -1) + (edge[3] != -1);
+					if (crossed == 2)
+					{
+						int ends[2];
+						int n = 0;
+						for (int e = 0; e < 4; ++e)
+						{
+							if (edge[e] != -1)
+							{
+								ends[n++] = edge[e];
+							}
+						}
+						link(ends[0], ends[1]);
+					}
+					else if (crossed == 4)
+					{
+						// saddle, resolved by the cell average
+						bool center = (a + b + c + d) / 4 >= k * step;
+						if (center == ia)
+						{
+							link(edge[0], edge[1]);
+							link(edge[2], edge[3]);
+						}
+						else
+						{
+							link(edge[0], edge[3]);
+							link(edge[1], edge[2]);
+						}
+					}
+				}
 			}
+
+			std::swap(hTop, hBottom);
 		}
-	}
 
-	for (size_t i = 0; i < contours.size(); ++i)
-	{
-		Contour& c = contours[i];
-		c.index = i;
-		c.value = i + 1;
+		// walk the chains: open ones start at border nodes, the remaining ones are loops
+		std::vector<ContoursOperations::Isoline> isolines;
+		std::vector<bool> visited(nodes.size(), false);
 
-		bool isClosed = true;
+		auto walk = [&](int start, bool closed)
+			{
+				ContoursOperations::Isoline iso;
+				iso.level = nodes[start].level * step;
+				iso.isClosed = closed;
 
-		if (cv::norm(contours[i].points.front() - contours[i].points.back()) > 3)
+				int prev = -1;
+				int cur = start;
+				while (cur != -1 && !visited[cur])
+				{
+					visited[cur] = true;
+					iso.points.push_back(nodes[cur].pt);
+					int next = nodes[cur].link[0] != prev ? nodes[cur].link[0] : nodes[cur].link[1];
+					prev = cur;
+					cur = next;
+				}
+				if (closed)
+				{
+					iso.points.push_back(nodes[start].pt);
+				}
+				isolines.push_back(std::move(iso));
+			};
+
+		for (size_t i = 0; i < nodes.size(); ++i)
 		{
-			isClosed = false;
+			if (!visited[i] && nodes[i].link[1] == -1)
+			{
+				walk(static_cast<int>(i), false);
+			}
+		}
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			if (!visited[i])
+			{
+				walk(static_cast<int>(i), true);
+			}
 		}
 
-		c.isClosed = isClosed;
+		return isolines;
+	}
+}
 
-		c.boundingRect = cv::boundingRect(contours[i].points);
+cv::Mat ContoursOperations::generateField(const GenerationParams& params, RandomGenerator& gen)
+{
+	const siv::PerlinNoise::seed_type seed = gen.getRandomInt(INT_MAX);
+	return generateFieldRegion(params, seed, cv::Rect(0, 0, params.height, params.width));
+}
+
+cv::Mat ContoursOperations::generateFieldRegion(const GenerationParams& params, uint32_t seed, const cv::Rect& region)
+{
+	if (params.singlePrecision)
+	{
+		return generateFieldImpl<float>(params, seed, region);
 	}
+	return generateFieldImpl<double>(params, seed, region);
 }
 
-void ContoursOperations::extractContour(int x_start, int y_start, cv::Mat& img, std::vector<cv::Point>& contour)
+cv::Mat ContoursOperations::generateIsolines(const GenerationParams& params, RandomGenerator& gen)
 {
-	int width = img.cols;
-	int height = img.rows;
+	return generateIsolines(generateField(params, gen));
+}
+
+cv::Mat ContoursOperations::generateIsolines(cv::Mat field)
+{
+	if (field.depth() == CV_32F)
+	{
+		return isolinesFromField<float>(field);
+	}
+	return isolinesFromField<double>(field);
+}
+
+std::vector<ContoursOperations::Isoline> ContoursOperations::traceIsolines(const cv::Mat& field, double step)
+{
+	if (field.depth() == CV_32F)
+	{
+		return traceIsolinesImpl<float>(field, step);
+	}
+	return traceIsolinesImpl<double>(field, step);
+}
 
-	int x = x_start;
-	int y = y_start;
+void ContoursOperations::isolinesToContours(const std::vector<Isoline>& isolines, cv::Size size, cv::Point offset, std::vector<Contour>& contours)
+{
+	cv::Rect bounds(cv::Point(0, 0), size);
+
+	std::vector<std::vector<cv::Point>> pieces;
+	for (const auto& iso : isolines)
+	{
+		// the image border cuts the chain into pieces, a new one starts where it re-enters
+		pieces.assign(1, std::vector<cv::Point>());
+		bool cut = false;
+		auto addPixel = [&](const cv::Point& p)
+			{
+				if (!bounds.contains(p))
+				{
+					if (!pieces.back().empty())
+					{
+						pieces.emplace_back();
+					}
+					cut = true;
+					return;
+				}
+				auto& piece = pieces.back();
+				if (piece.empty() || piece.back() != p)
+				{
+					piece.push_back(p);
+				}
+			};
 
-	auto isContour = [&](int x, int y) -> bool
+		// 8-connected pixel chain through the rounded vertices
+		cv::Point prev(-1, -1);
+		for (size_t i = 0; i < iso.points.size(); ++i)
 		{
-			if (x < 0 || x >= width || y < 0 || y >= height)
+			cv::Point pt(cvRound(iso.points[i].x), cvRound(iso.points[i].y));
+			pt -= offset;
+			if (i == 0)
 			{
-				return false;
+				prev = pt;
+				addPixel(pt);
+				continue;
 			}
-			return img.at<uchar>(y, x) == 255;
-		};
 
-	std::stack<cv::Point> stack;
-
-	stack.push(cv::Point(x, y));
+			cv::LineIterator it(prev, pt, 8);
+			++it; // first pixel is already in the chain
+			for (int k = 1; k < it.count; ++k, ++it)
+			{
+				addPixel(it.pos());
+			}
+			prev = pt;
+		}
+		if (pieces.back().empty())
+		{
+			pieces.pop_back();
+		}
 
-	Direction direction = Direction::NONE;
+		if (!cut && !pieces.empty())
+		{
+			auto& points = pieces.front();
+			if (iso.isClosed && points.size() > 1 && points.front() == points.back())
+			{
+				points.pop_back();
+			}
+		}
+		else if (iso.isClosed && pieces.size() > 1 && !pieces.front().empty() && !pieces.back().empty()
+			&& pieces.back().back() == pieces.front().front())
+		{
+			// a closed isoline starting inside the image: its last piece continues into the first one
+			auto& last = pieces.back();
+			last.insert(last.end(), pieces.front().begin() + 1, pieces.front().end());
+			pieces.front() = std::move(last);
+			pieces.pop_back();
+		}
 
-	cv::Point prev_point = cv::Point(x, y);
+		for (auto& points : pieces)
+		{
+			if (points.empty())
+			{
+				continue;
+			}
 
-	bool reverse = false;
+			Contour c;
+			c.level = iso.level;
+			c.isClosed = iso.isClosed && !cut;
+			c.points = std::move(points);
+			c.index = static_cast<int>(contours.size());
+			c.value = c.index + 1;
+			c.boundingRect = cv::boundingRect(c.points);
+			contours.push_back(std::move(c));
+		}
+	}
+}
 
-	while (!stack.empty())
+namespace
+{
+	struct TraceStep
 	{
-		cv::Point p = stack.top();
-		stack.pop();
-
-		if (img.at<uchar>(p.y, p.x) == 255)
+		int dx, dy;
+		Direction direction; // direction of the move, selects the order of the next search
+	};
+
+	constexpr TraceStep kTop{ 0, -1, Direction::TOP };
+	constexpr TraceStep kTopRight{ 1, -1, Direction::TOP_RIGHT };
+	constexpr TraceStep kRight{ 1, 0, Direction::RIGHT };
+	constexpr TraceStep kBottomRight{ 1, 1, Direction::BOTTOM_RIGHT };
+	constexpr TraceStep kDown{ 0, 1, Direction::DOWN };
+	constexpr TraceStep kBottomLeft{ -1, 1, Direction::BOTTOM_LEFT };
+	constexpr TraceStep kLeft{ -1, 0, Direction::LEFT };
+	constexpr TraceStep kTopLeft{ -1, -1, Direction::TOP_LEFT };
+
+	// Neighbours to search after a move in each Direction: straight ahead first, the way back is never searched.
+	// NONE (start of a pass) searches all 8 neighbours.
+	constexpr int kMaxNeighbours = 8;
+	constexpr TraceStep kSearchOrder[9][kMaxNeighbours] = {
+		/* TOP          */ { kTop, kTopRight, kTopLeft, kRight, kLeft, kBottomRight, kBottomLeft },
+		/* TOP_RIGHT    */ { kTopRight, kTop, kRight, kTopLeft, kBottomRight, kDown, kLeft },
+		/* RIGHT        */ { kRight, kTopRight, kBottomRight, kTop, kDown, kTopLeft, kBottomLeft },
+		/* BOTTOM_RIGHT */ { kBottomRight, kRight, kDown, kTopRight, kBottomLeft, kLeft, kTop },
+		/* DOWN         */ { kDown, kBottomRight, kBottomLeft, kRight, kLeft, kTopRight, kTopLeft },
+		/* BOTTOM_LEFT  */ { kBottomLeft, kDown, kLeft, kBottomRight, kTopLeft, kTop, kRight },
+		/* LEFT         */ { kLeft, kBottomLeft, kTopLeft, kDown, kTop, kBottomRight, kTopRight },
+		/* TOP_LEFT     */ { kTopLeft, kTop, kLeft, kTopRight, kBottomLeft, kDown, kRight },
+		/* NONE         */ { kTop, kTopRight, kTopLeft, kRight, kLeft, kBottomRight, kBottomLeft, kDown },
+	};
+	constexpr int kSearchSize[9] = { 7, 7, 7, 7, 7, 7, 7, 7, 8 };
+
+	// Follows a thinned line from (x, y) in both directions and clears the visited pixels.
+	// origin is pixel (0, 0) of an image with a zero border of 1 pixel, so neighbours need no bounds checks.
+	// The second pass continues from the start after the first pass is reversed, the contour runs end to end.
+	void traceContour(uchar* origin, ptrdiff_t step, const ptrdiff_t (&offsets)[9][kMaxNeighbours], int x, int y, std::vector<cv::Point>& contour)
+	{
+		for (int pass = 0; pass < 2; ++pass)
 		{
-			contour.push_back(p);
-			img.at<uchar>(p.y, p.x) = 0;
-		}
+			int px = x;
+			int py = y;
+			uchar* pixel = origin + py * step + px;
+			int direction = static_cast<int>(Direction::NONE);
 
-		direction = getDirection(prev_point, p);
+			while (true)
+			{
+				if (*pixel == 255)
+				{
+					contour.emplace_back(px, py);
+					*pixel = 0;
+				}
 
-		std::vector<cv::Point> neighbours = getOrder(p, direction);
+				const TraceStep* order = kSearchOrder[direction];
+				const ptrdiff_t* offset = offsets[direction];
+				const int size = kSearchSize[direction];
 
-		for (const auto& n : neighbours)
-		{
-			if (isContour(n.x, n.y))
+				int next = 0;
+				while (next < size && pixel[offset[next]] != 255)
+				{
+					++next;
+				}
+				if (next == size)
+				{
+					break;
+				}
+
+				px += order[next].dx;
+				py += order[next].dy;
+				pixel += offset[next];
+				direction = static_cast<int>(order[next].direction);
+			}
+
+			if (pass == 0)
 			{
-				stack.push(n);
-				break;
+				std::reverse(contour.begin(), contour.end());
 			}
 		}
+	}
+}
 
-		prev_point = p;
+void ContoursOperations::findContours(const cv::Mat& img, std::vector<Contour>& contours)
+{
+	int width = img.cols;
+	int height = img.rows;
+
+	cv::Mat mat;
+	cv::copyMakeBorder(img, mat, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(0));
 
-		if (stack.empty())
+	uchar* origin = mat.ptr<uchar>(1) + 1;
+	ptrdiff_t step = static_cast<ptrdiff_t>(mat.step);
+
+	ptrdiff_t offsets[9][kMaxNeighbours] = {};
+	for (int d = 0; d < 9; ++d)
+	{
+		for (int k = 0; k < kSearchSize[d]; ++k)
+		{
+			offsets[d][k] = kSearchOrder[d][k].dy * step + kSearchOrder[d][k].dx;
+		}
+	}
+
+	for (int m = 0; m < height; ++m)
+	{
+		const uchar* row = origin + m * step;
+		for (int n = 0; n < width; ++n)
 		{
-			if (!reverse)
+			if (row[n] == 255)
 			{
-				reverse = true;
+				Contour c;
+				traceContour(origin, step, offsets, n, m, c.points);
+				contours.push_back(std::move(c));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		Contour& c = contours[i];
+		c.index = i;
+		c.value = i + 1;
 
-				cv::Point point(x, y);
+		bool isClosed = true;
 
-				stack.push(point);
-				std::reverse(contour.begin(), contour.end());
-				prev_point = point;
-			}
+		if (cv::norm(contours[i].points.front() - contours[i].points.back()) > 3)
+		{
+			isClosed = false;
 		}
+
+		c.isClosed = isClosed;
+
+		c.boundingRect = cv::boundingRect(contours[i].points);
 	}
 }
 
@@ -206,104 +606,259 @@ Direction ContoursOperations::getDirection(cv::Point prev, cv::Point next)
 	return direction;
 }
 
-std::vector<cv::Point> ContoursOperations::getOrder(cv::Point pt, Direction direction)
+namespace
+{
+	// Consecutive pixels of one label on a row, zero pixels between them are ignored
+	struct LabelRun
+	{
+		int x;
+		int label;
+	};
+
+	void collectRuns(const int* row, int width, std::vector<LabelRun>& runs)
+	{
+		runs.clear();
+		int prev = 0;
+		for (int x = 0; x < width; ++x)
+		{
+			int val = row[x];
+			if (val != 0 && val != prev)
+			{
+				runs.push_back({ x, val });
+				prev = val;
+			}
+		}
+	}
+}
+
+cv::Mat ContoursOperations::labelContours(const std::vector<Contour>& contours, cv::Size size)
 {
-	switch (direction)
-	{
-	case Direction::TOP:
-		return { cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1) };
-	case Direction::TOP_RIGHT:
-		return { cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y) };
-	case Direction::RIGHT:
-		return { cv::Point(pt.x + 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1) };
-	case Direction::BOTTOM_RIGHT:
-		return { cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x, pt.y - 1) };
-	case Direction::DOWN:
-		return { cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1) };
-	case Direction::BOTTOM_LEFT:
-		return { cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y) };
-	case Direction::LEFT:
-		return { cv::Point(pt.x - 1, pt.y), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x + 1, pt.y - 1) };
-	case Direction::TOP_LEFT:
-		return { cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x, pt.y - 1), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1), cv::Point(pt.x + 1, pt.y) };
-	default:
-		return { cv::Point(pt.x, pt.y - 1), cv::Point(pt.x + 1, pt.y - 1), cv::Point(pt.x - 1, pt.y - 1), cv::Point(pt.x + 1, pt.y), cv::Point(pt.x - 1, pt.y), cv::Point(pt.x + 1, pt.y + 1), cv::Point(pt.x - 1, pt.y + 1), cv::Point(pt.x, pt.y + 1) };
+	cv::Mat labels = cv::Mat::zeros(size, CV_32SC1);
+	for (const Contour& c : contours)
+	{
+		int label = static_cast<int>(c.value);
+		for (const cv::Point& pt : c.points)
+		{
+			labels.at<int>(pt) = label;
+		}
 	}
+	return labels;
 }
 
-void ContoursOperations::findDepth(cv::Mat& img, std::vector<Contour>& contours)
+void ContoursOperations::findDepth(const cv::Mat& img, std::vector<Contour>& contours)
 {
+	CV_Assert(img.type() == CV_32SC1);
+
 	int width = img.cols;
-	int height = img.rows;
+	int count = static_cast<int>(contours.size());
+
+	// contours are tested on the row of their first point, left to right, so every row is swept once for all of its contours
+	std::vector<int> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+		{
+			const cv::Point& pa = contours[a].points[0];
+			const cv::Point& pb = contours[b].points[0];
+			return pa.y < pb.y || (pa.y == pb.y && pa.x < pb.x);
+		});
+
+	std::vector<LabelRun> runs;
+	runs.reserve(width);
 
-	for (int k = 0; k < contours.size(); ++k)
+	// labels crossed an odd number of times left of the sweep position, innermost on top.
+	// Labels turning even are removed when they are on top and skipped below it
+	std::vector<uchar> parity(count + 1, 0);
+	std::vector<int> odd;
+	odd.reserve(count);
+
+	size_t next = 0; // first run right of the sweep position
+	int runsRow = -1;
+	for (int k : order)
 	{
 		Contour& c = contours[k];
-		std::set<int> outers_left;
-		std::set<int> outers_right;
+		cv::Point start = c.points[0];
+		int own = static_cast<int>(c.value);
 
-		int y = c.points[0].y;
-		uchar prev = 0;
-		for (int x = 0; x < width; ++x)
+		if (start.y != runsRow)
 		{
-			uchar val = img.at<uchar>(y, x);
+			for (int label : odd)
+			{
+				parity[label] = 0;
+			}
+			odd.clear();
+			collectRuns(img.ptr<int>(start.y), width, runs);
+			runsRow = start.y;
+			next = 0;
+		}
 
-			if (val == prev)
+		for (; next < runs.size() && runs[next].x < start.x; ++next)
+		{
+			int label = runs[next].label;
+			if (label < 1 || label > count)
 			{
 				continue;
 			}
+			parity[label] ^= 1;
+			if (parity[label])
+			{
+				odd.push_back(label);
+			}
+			else if (odd.back() == label)
+			{
+				odd.pop_back();
+			}
+		}
+		while (!odd.empty() && !parity[odd.back()])
+		{
+			odd.pop_back();
+		}
+
+		// the parent is the innermost odd label whose bounding rect holds this contour
+		c.parent = -1;
+		for (auto it = odd.rbegin(); it != odd.rend(); ++it)
+		{
+			const Contour& outer = contours[*it - 1];
+			if (*it != own && parity[*it] && (outer.boundingRect & c.boundingRect) == c.boundingRect)
+			{
+				c.parent = *it - 1;
+				break;
+			}
+		}
+	}
+
+	// depth is the length of the parent chain, a chain running into a contour on the chain is cut there
+	const int unknown = -1, visiting = -2;
+	for (Contour& c : contours)
+	{
+		c.depth = unknown;
+	}
+	std::vector<int> chain;
+	for (int k = 0; k < count; ++k)
+	{
+		int i = k;
+		while (contours[i].depth == unknown)
+		{
+			contours[i].depth = visiting;
+			chain.push_back(i);
+			int parent = contours[i].parent;
+			if (parent < 0)
+			{
+				break;
+			}
+			if (contours[parent].depth == visiting)
+			{
+				contours[i].parent = -1;
+				break;
+			}
+			i = parent;
+		}
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+		{
+			Contour& c = contours[*it];
+			c.depth = c.parent < 0 ? 0 : contours[c.parent].depth + 1;
+		}
+		chain.clear();
+	}
+}
+
+namespace
+{
+	// Contour labels 4-adjacent to every region (sorted) and one pixel of every region, in one pass over the images
+	void collectRegionBorders(const cv::Mat& regions, const cv::Mat& labels, int regionCount, int labelCount,
+		std::vector<std::vector<int>>& borders, std::vector<cv::Point>& samples)
+	{
+		borders.assign(regionCount, std::vector<int>());
+		samples.assign(regionCount, cv::Point(-1, -1));
 
-			if (val != 0 && val != c.value)
+		auto addBorder = [&](int region, int label)
 			{
-				if (x < c.points[0].x)
+				if (label < 1 || label > labelCount)
 				{
-					if (outers_left.find(val) == outers_left.end())
-					{
-						outers_left.insert(val);
-					}
-					else
-					{
-						outers_left.erase(val);
-					}
+					return;
 				}
-				else
+				auto& border = borders[region];
+				if (border.empty() || border.back() != label)
 				{
-					if (outers_right.find(val) == outers_right.end())
-					{
-						outers_right.insert(val);
-					}
-					else
-					{
-						outers_right.erase(val);
-					}
+					border.push_back(label);
 				}
-				prev = val;
-			}
-
-			std::set<int> outers;
-			std::set_union(outers_left.begin(), outers_left.end(), outers_right.begin(), outers_right.end(), std::inserter(outers, outers.begin()));
+			};
 
-			for (auto iter = outers.begin(); iter != outers.end();)
+		for (int y = 0; y < regions.rows; ++y)
+		{
+			const int* regionRow = regions.ptr<int>(y);
+			const int* labelRow = labels.ptr<int>(y);
+			const int* nextRegionRow = y + 1 < regions.rows ? regions.ptr<int>(y + 1) : nullptr;
+			const int* nextLabelRow = y + 1 < regions.rows ? labels.ptr<int>(y + 1) : nullptr;
+			for (int x = 0; x < regions.cols; ++x)
 			{
-				int id = *iter;
-				Contour& outer = contours[id - 1];
-				if ((outer.boundingRect & c.boundingRect) != c.boundingRect)
+				int region = regionRow[x];
+				if (region != 0 && samples[region].x < 0)
 				{
-					iter = outers.erase(iter);
+					samples[region] = cv::Point(x, y);
 				}
-				else
+
+				// right and bottom neighbours, a region pixel next to a contour pixel adds the label to the region
+				if (x + 1 < regions.cols && (region == 0) != (regionRow[x + 1] == 0))
 				{
-					++iter;
+					region != 0 ? addBorder(region, labelRow[x + 1]) : addBorder(regionRow[x + 1], labelRow[x]);
 				}
+				if (nextRegionRow && (region == 0) != (nextRegionRow[x] == 0))
+				{
+					region != 0 ? addBorder(region, nextLabelRow[x]) : addBorder(nextRegionRow[x], labelRow[x]);
+				}
+			}
+		}
+
+		for (auto& border : borders)
+		{
+			std::sort(border.begin(), border.end());
+			border.erase(std::unique(border.begin(), border.end()), border.end());
+		}
+	}
+
+	// Index of the contour the region lies directly inside, -1 if there is none.
+	// The inside of a contour is bounded by the contour and its children, so a parent and a child on the border name it.
+	// Otherwise the region is inside a contour without children or outside of every contour on its border,
+	// a region touching a single contour that has a parent is inside it (outside it would touch the parent),
+	// the rest is decided by one point test per bordering contour
+	int regionOwner(const std::vector<int>& border, const cv::Point& sample, const std::vector<Contour>& contours)
+	{
+		int owner = -1;
+		for (int label : border)
+		{
+			int parent = contours[label - 1].parent;
+			if (parent >= 0 && std::binary_search(border.begin(), border.end(), parent + 1)
+				&& (owner == -1 || contours[parent].depth > contours[owner].depth))
+			{
+				owner = parent;
 			}
+		}
+		if (owner != -1)
+		{
+			return owner;
+		}
 
-			c.depth = outers.size();
+		if (border.size() == 1 && contours[border[0] - 1].parent != -1)
+		{
+			return border[0] - 1;
 		}
+
+		for (int label : border)
+		{
+			const Contour& c = contours[label - 1];
+			if ((owner == -1 || c.depth > contours[owner].depth) && cv::pointPolygonTest(c.points, sample, false) > 0)
+			{
+				owner = label - 1;
+			}
+		}
+		return owner;
 	}
 }
 
-void ContoursOperations::fillContours(cv::Mat& contoursMat, const std::vector<Contour>& contours, cv::Mat& drawing)
+void ContoursOperations::fillContours(const cv::Mat& contoursMat, const std::vector<Contour>& contours, cv::Mat& drawing)
 {
+	CV_Assert(contoursMat.type() == CV_32SC1);
+
 	int max_depth = 0;
 
 	for (auto& c : contours)
@@ -316,60 +871,128 @@ void ContoursOperations::fillContours(cv::Mat& contoursMat, const std::vector<Co
 
 	ColorScaler scaler(-1, max_depth, cv::Scalar(18, 185, 27), cv::Scalar(20, 20, 185));
 
-	int width = contoursMat.cols;
-	int height = contoursMat.rows;
+	// regions between the contours, 4-connected as cv::floodFill fills them; label 0 is the contours
+	cv::Mat regions;
+	int regionCount = cv::connectedComponents(contoursMat == 0, regions, 4, CV_32S);
+
+	// every region gets the depth of the contour it lies directly inside,
+	// regions inside no contour are holes and get the color of depth -1
+	std::vector<std::vector<int>> borders;
+	std::vector<cv::Point> samples;
+	collectRegionBorders(regions, contoursMat, regionCount, static_cast<int>(contours.size()), borders, samples);
+
+	std::vector<int> regionDepth(regionCount, -1);
+	for (int i = 1; i < regionCount; ++i)
+	{
+		int owner = regionOwner(borders[i], samples[i], contours);
+		if (owner != -1)
+		{
+			regionDepth[i] = contours[owner].depth;
+		}
+	}
+
+	std::vector<cv::Vec3b> regionColor(regionCount);
+	for (int i = 1; i < regionCount; ++i)
+	{
+		cv::Scalar color = scaler.getColor(regionDepth[i]);
+		// rounded like cv::floodFill rounds the fill color
+		regionColor[i] = cv::Vec3b(cv::saturate_cast<uchar>(color[0]), cv::saturate_cast<uchar>(color[1]), cv::saturate_cast<uchar>(color[2]));
+	}
 
-	for (int k = 0; k < contours.size(); ++k)
+	for (int i = 0; i < drawing.rows; ++i)
 	{
-		const Contour& c = contours[k];
-		cv::Point seed_point(-1, -1);
+		const int* regionRow = regions.ptr<int>(i);
+		cv::Vec3b* drawingRow = drawing.ptr<cv::Vec3b>(i);
+		for (int j = 0; j < drawing.cols; ++j)
+		{
+			if (regionRow[j] != 0)
+			{
+				drawingRow[j] = regionColor[regionRow[j]];
+			}
+		}
+	}
+}
+
+void ContoursOperations::fillFromNeighbours(cv::Mat& image, const cv::Mat& mask)
+{
+	CV_Assert(image.type() == CV_8UC3 && mask.type() == CV_8UC1 && image.size() == mask.size());
+
+	// pixel states with a 1 pixel border, so neighbours need no bounds checks
+	enum State : uchar { KNOWN = 0, MASKED = 1, QUEUED = 2, OUTSIDE = 3 };
+	cv::Mat state;
+	cv::copyMakeBorder(mask != 0, state, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(OUTSIDE));
+	state.setTo(MASKED, state == 255);
 
-		// try point polygon test to find seed point
-		for (auto& pt : c.points)
+	const int dx[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+	const int dy[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+	// first layer: masked pixels next to a known one
+	std::vector<cv::Point> layer;
+	for (int y = 0; y < image.rows; ++y)
+	{
+		const uchar* maskRow = mask.ptr<uchar>(y);
+		for (int x = 0; x < image.cols; ++x)
 		{
-			for (int m = -1; m <= 1; ++m)
+			if (maskRow[x] == 0)
+			{
+				continue;
+			}
+			for (int k = 0; k < 8; ++k)
 			{
-				for (int n = -1; n <= 1; ++n)
+				if (state.at<uchar>(y + dy[k] + 1, x + dx[k] + 1) == KNOWN)
 				{
-					if (m == 0 && n == 0)
-					{
-						continue;
-					}
-					cv::Point p(pt.x + m, pt.y + n);
-					if (p.x < 0 || p.x >= width || p.y < 0 || p.y >= height)
-					{
-						continue;
-					}
-					if (contoursMat.at<uchar>(p) == 0)
-					{
-						if (cv::pointPolygonTest(c.points, p, false) > 0)
-						{
-							seed_point = p;
-							goto floodfill;
-						}
-					}
+					layer.emplace_back(x, y);
+					state.at<uchar>(y + 1, x + 1) = QUEUED;
+					break;
 				}
 			}
 		}
+	}
 
-	floodfill:
-		if (seed_point.x != -1)
+	std::vector<cv::Vec3b> colors;
+	std::vector<cv::Point> next;
+	while (!layer.empty())
+	{
+		// colors of a layer come only from the previous layers
+		colors.resize(layer.size());
+		for (size_t i = 0; i < layer.size(); ++i)
 		{
-			cv::Scalar color = scaler.getColor(c.depth);
-			cv::floodFill(drawing, seed_point, color);
+			const cv::Point& p = layer[i];
+			int sum[3] = { 0, 0, 0 };
+			int count = 0;
+			for (int k = 0; k < 8; ++k)
+			{
+				if (state.at<uchar>(p.y + dy[k] + 1, p.x + dx[k] + 1) == KNOWN)
+				{
+					const cv::Vec3b& c = image.at<cv::Vec3b>(p.y + dy[k], p.x + dx[k]);
+					sum[0] += c[0];
+					sum[1] += c[1];
+					sum[2] += c[2];
+					++count;
+				}
+			}
+			colors[i] = cv::Vec3b((sum[0] + count / 2) / count, (sum[1] + count / 2) / count, (sum[2] + count / 2) / count);
 		}
-	}
 
-	// fill the holes
-	cv::Scalar hole_color = scaler.getColor(-1);
-	for (int i = 0; i < drawing.rows; ++i)
-	{
-		for (int j = 0; j < drawing.cols; ++j)
+		next.clear();
+		for (size_t i = 0; i < layer.size(); ++i)
+		{
+			const cv::Point& p = layer[i];
+			image.at<cv::Vec3b>(p) = colors[i];
+			state.at<uchar>(p.y + 1, p.x + 1) = KNOWN;
+		}
+		for (const cv::Point& p : layer)
 		{
-			if (drawing.at<cv::Vec3b>(i, j) == cv::Vec3b(0, 0, 0))
+			for (int k = 0; k < 8; ++k)
 			{
-				cv::floodFill(drawing, cv::Point(j, i), hole_color);
+				uchar& s = state.at<uchar>(p.y + dy[k] + 1, p.x + dx[k] + 1);
+				if (s == MASKED)
+				{
+					s = QUEUED;
+					next.emplace_back(p.x + dx[k], p.y + dy[k]);
+				}
 			}
 		}
+		layer.swap(next);
 	}
 }
\ No newline at end of file
@@ -7,8 +7,10 @@ struct Contour
     double value;
     bool isClosed;
     int depth;
+    int parent = -1; // index of the innermost enclosing contour
     std::vector<cv::Point> points;
     cv::Rect boundingRect;
+    double level = 0; // field level, known only for marching squares contours
 };
 
 class ColorScaler
@@ -36,6 +38,21 @@ enum class Direction
     NONE
 };
 
+class RandomGenerator;
+
+enum class ContourEngine
+{
+    RASTER, // Sobel of the fractional field, thinning and pixel tracing
+    MARCHING_SQUARES // sub-pixel isolines traced directly on the field
+};
+
+enum class NoiseMode
+{
+    SINGLE, // one octave of Perlin noise
+    FBM, // fractal Brownian motion: octaves of doubled frequency, the amplitude scaled by persistence
+    RIDGED // octaves folded to (1 - |noise|)^2, sharp ridges along the zero crossings
+};
+
 struct GenerationParams
 {
     int width, height; // image size
@@ -47,17 +64,48 @@ struct GenerationParams
     bool fillContours; // fill contours with color
     bool drawValues; // draw values on isolines
     int textDistance; // minimal distance between texts on isolines
+    bool singlePrecision; // evaluate noise field and gradients in float instead of double
+    ContourEngine engine; // how contours are extracted from the noise field
+    bool inpaintTelea; // repaint contour pixels and the border with cv::inpaint TELEA instead of copying neighbour colors
+    NoiseMode noiseMode; // how octaves of noise make up the field
+    int octaves; // number of octaves of FBM and RIDGED, at least 1
+    double persistence; // amplitude ratio of neighbouring octaves of FBM and RIDGED
 };
 
 namespace ContoursOperations
 {
-    cv::Mat generateIsolines(const GenerationParams& params);
+    struct Isoline
+    {
+        double level;
+        bool isClosed;
+        std::vector<cv::Point2f> points; // closed isolines repeat the first point at the end
+    };
+
+    // Perlin noise in [0, 1] (one octave or params.octaves of params.noiseMode) multiplied by params.mul,
+    // CV_32F or CV_64F depending on params.singlePrecision
+    cv::Mat generateField(const GenerationParams& params, RandomGenerator& gen);
+    // Part of the field generated from a noise seed, region is in field coordinates (x is the column).
+    // Values are bit-identical to the same pixels of the whole field, so tiles of a map can be generated independently
+    cv::Mat generateFieldRegion(const GenerationParams& params, uint32_t seed, const cv::Rect& region);
+    cv::Mat generateIsolines(const GenerationParams& params, RandomGenerator& gen);
+    // Isolines mask of a field from generateField, the pixels of the field are overwritten by their fractional part
+    cv::Mat generateIsolines(cv::Mat field);
+    // Marching squares isolines of the field at every multiple of step
+    std::vector<Isoline> traceIsolines(const cv::Mat& field, double step);
+    // Rasterize isolines to 8-connected pixel contours inside an image of the given size, shifted by -offset.
+    // An isoline leaving the image gives one open contour per part inside it
+    void isolinesToContours(const std::vector<Isoline>& isolines, cv::Size size, cv::Point offset, std::vector<Contour>& contours);
+    // Trace 8-connected lines of 255 pixels of a thinned image, without allocations per traced pixel
     void findContours(const cv::Mat& img, std::vector<Contour>& contours);
-    void extractContour(int x_start, int y_start, cv::Mat& img, std::vector<cv::Point>& contour);
     Direction getDirection(cv::Point prev, cv::Point next);
-    std::vector<cv::Point> getOrder(cv::Point pt, Direction direction);
-    // Find depth of each contour
-    void findDepth(cv::Mat& img, std::vector<Contour>& contours);
-    void fillContours(cv::Mat& contoursMat, const std::vector<Contour>& contours, cv::Mat& drawing);
+    // CV_32SC1 image of contour values (index + 1), 0 outside of contours
+    cv::Mat labelContours(const std::vector<Contour>& contours, cv::Size size);
+    // Find parent and depth of each contour from the label image. Every row holding first points is swept once left to right,
+    // the parent is the innermost label crossed an odd number of times left of the first point, the depth is the length of the parent chain
+    void findDepth(const cv::Mat& img, std::vector<Contour>& contours);
+    // Replace the masked pixels of a CV_8UC3 image by the mean of their unmasked neighbours, layer by layer from the mask edge
+    void fillFromNeighbours(cv::Mat& image, const cv::Mat& mask);
+    // Fill the regions between contours with the color of their depth, contoursMat is the label image
+    void fillContours(const cv::Mat& contoursMat, const std::vector<Contour>& contours, cv::Mat& drawing);
 };
 
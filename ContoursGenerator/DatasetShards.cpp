@@ -0,0 +1,341 @@
+#include "DatasetShards.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	const int kTarBlock = 512;
+
+	// header block and data padded to whole blocks
+	qint64 entryBytes(size_t dataSize)
+	{
+		return kTarBlock + (static_cast<qint64>(dataSize) + kTarBlock - 1) / kTarBlock * kTarBlock;
+	}
+
+	QString shardName(int number, const char* extension)
+	{
+		return QString("shard-%1%2").arg(number, 6, 10, QChar('0')).arg(extension);
+	}
+
+	// octal number of width - 1 digits followed by NUL
+	void writeOctal(char* field, int width, uint64_t value)
+	{
+		std::snprintf(field, width, "%0*llo", width - 1, static_cast<unsigned long long>(value));
+	}
+
+	// ustar header of a regular file
+	void tarHeader(const QByteArray& name, uint64_t size, char (&header)[kTarBlock])
+	{
+		std::memset(header, 0, kTarBlock);
+		std::memcpy(header, name.constData(), std::min<int>(name.size(), 99));
+		writeOctal(header + 100, 8, 0644);
+		writeOctal(header + 108, 8, 0);
+		writeOctal(header + 116, 8, 0);
+		writeOctal(header + 124, 12, size);
+		writeOctal(header + 136, 12, 0);
+		header[156] = '0';
+		std::memcpy(header + 257, "ustar", 6);
+		std::memcpy(header + 263, "00", 2);
+
+		// checksum is computed with its own field filled with spaces
+		std::memset(header + 148, ' ', 8);
+		unsigned int checksum = 0;
+		for (int i = 0; i < kTarBlock; ++i)
+		{
+			checksum += static_cast<unsigned char>(header[i]);
+		}
+		std::snprintf(header + 148, 8, "%06o", checksum);
+		header[155] = ' ';
+	}
+
+	cv::Mat decode(const std::vector<uchar>& data, int flags)
+	{
+		// npy files start with the magic string, everything else goes to OpenCV
+		if (data.size() > 6 && std::memcmp(data.data(), "\x93NUMPY", 6) == 0)
+		{
+			return EncodeOperations::decodeNpy(data);
+		}
+		return cv::imdecode(data, flags);
+	}
+}
+
+ShardWriter::ShardWriter(const QString& folderPath, const OutputFormat& format) :
+	m_folderPath(folderPath)
+	, m_format(format)
+{
+	QDir().mkpath(m_folderPath);
+	loadManifest();
+}
+
+ShardWriter::~ShardWriter()
+{
+	closeShard();
+}
+
+uint64_t ShardWriter::nextKey() const
+{
+	return m_nextKey;
+}
+
+bool ShardWriter::append(uint64_t key, const std::vector<uchar>& image, const std::vector<uchar>& mask)
+{
+	// a shard holds at least one sample, even if the sample alone is larger than the limit,
+	// the limit counts the end of archive marker written by closeShard()
+	if (m_tar.isOpen() && m_tar.size() + entryBytes(image.size()) + entryBytes(mask.size()) + 2 * kTarBlock > m_format.shardBytes)
+	{
+		closeShard();
+	}
+	if (!m_tar.isOpen() && !openShard())
+	{
+		return false;
+	}
+
+	QByteArray base = QByteArray::number(static_cast<qulonglong>(key));
+	ShardIndexEntry entry{};
+	entry.key = qToLittleEndian<quint64>(key);
+	uint64_t imageOffset = 0, maskOffset = 0;
+
+	// a failed sample is cut off again, so the tar stays readable and the next sample starts on a clean entry
+	qint64 tarStart = m_tar.pos();
+	qint64 indexStart = m_index.pos();
+	auto rollback = [&]()
+		{
+			m_tar.resize(tarStart);
+			m_tar.seek(tarStart);
+			m_index.resize(indexStart);
+			m_index.seek(indexStart);
+			return false;
+		};
+
+	if (!writeEntry(base + ".image" + EncodeOperations::extension(m_format.imageCodec), image, imageOffset)
+		|| !writeEntry(base + ".mask" + EncodeOperations::extension(m_format.maskCodec), mask, maskOffset))
+	{
+		return rollback();
+	}
+	entry.imageOffset = qToLittleEndian<quint64>(imageOffset);
+	entry.imageSize = qToLittleEndian<quint64>(image.size());
+	entry.maskOffset = qToLittleEndian<quint64>(maskOffset);
+	entry.maskSize = qToLittleEndian<quint64>(mask.size());
+
+	if (m_index.write(reinterpret_cast<const char*>(&entry), sizeof(entry)) != sizeof(entry))
+	{
+		return rollback();
+	}
+
+	++m_shardSamples;
+	m_nextKey = std::max(m_nextKey, key + 1);
+	return true;
+}
+
+void ShardWriter::closeShard()
+{
+	if (!m_tar.isOpen())
+	{
+		return;
+	}
+
+	// end of archive: two zero blocks
+	QByteArray end(2 * kTarBlock, '\0');
+	m_tar.write(end);
+
+	QJsonObject shard;
+	shard["file"] = QFileInfo(m_tar).fileName();
+	shard["index"] = QFileInfo(m_index).fileName();
+	shard["samples"] = m_shardSamples;
+	shard["bytes"] = m_tar.size();
+	m_shards.append(shard);
+
+	m_tar.close();
+	m_index.close();
+	++m_shardNumber;
+	m_shardSamples = 0;
+
+	writeManifest();
+}
+
+bool ShardWriter::openShard()
+{
+	// never overwrite shards of an earlier session
+	while (QFile::exists(m_folderPath + "/" + shardName(m_shardNumber, ".tar")))
+	{
+		++m_shardNumber;
+	}
+
+	m_tar.setFileName(m_folderPath + "/" + shardName(m_shardNumber, ".tar"));
+	m_index.setFileName(m_folderPath + "/" + shardName(m_shardNumber, ".idx"));
+	if (!m_tar.open(QIODevice::WriteOnly) || !m_index.open(QIODevice::WriteOnly))
+	{
+		m_tar.close();
+		m_index.close();
+		return false;
+	}
+
+	// listed right away, so the shard is not lost from the manifest if the session never closes it
+	writeManifest();
+	return true;
+}
+
+bool ShardWriter::writeEntry(const QString& name, const std::vector<uchar>& data, uint64_t& dataOffset)
+{
+	char header[kTarBlock];
+	tarHeader(name.toUtf8(), data.size(), header);
+	if (m_tar.write(header, kTarBlock) != kTarBlock)
+	{
+		return false;
+	}
+
+	dataOffset = m_tar.pos();
+	if (m_tar.write(reinterpret_cast<const char*>(data.data()), data.size()) != static_cast<qint64>(data.size()))
+	{
+		return false;
+	}
+
+	// entries are padded to whole blocks
+	int padding = (kTarBlock - data.size() % kTarBlock) % kTarBlock;
+	return m_tar.write(QByteArray(padding, '\0')) == padding;
+}
+
+void ShardWriter::loadManifest()
+{
+	QFile file(m_folderPath + "/manifest.json");
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return;
+	}
+
+	QJsonObject manifest = QJsonDocument::fromJson(file.readAll()).object();
+	m_shards = manifest["shards"].toArray();
+	m_nextKey = static_cast<uint64_t>(manifest["nextKey"].toDouble());
+
+	// a shard left open by an interrupted session: its index file has the samples written before
+	for (int i = 0; i < m_shards.size(); ++i)
+	{
+		QJsonObject shard = m_shards[i].toObject();
+		if (!shard["open"].toBool())
+		{
+			continue;
+		}
+		ShardReader reader(m_folderPath + "/" + shard["file"].toString());
+		for (int j = 0; j < reader.count(); ++j)
+		{
+			m_nextKey = std::max(m_nextKey, reader.key(j) + 1);
+		}
+		shard.remove("open");
+		shard["samples"] = reader.count();
+		shard["bytes"] = QFileInfo(m_folderPath + "/" + shard["file"].toString()).size();
+		m_shards[i] = shard;
+	}
+}
+
+void ShardWriter::writeManifest() const
+{
+	QJsonArray shards = m_shards;
+	if (m_tar.isOpen())
+	{
+		// samples of the open shard are known once it is closed, its index file has them until then
+		QJsonObject shard;
+		shard["file"] = QFileInfo(m_tar).fileName();
+		shard["index"] = QFileInfo(m_index).fileName();
+		shard["samples"] = m_shardSamples;
+		shard["bytes"] = m_tar.size();
+		shard["open"] = true;
+		shards.append(shard);
+	}
+
+	qint64 samples = 0;
+	for (const auto& shard : shards)
+	{
+		samples += shard.toObject()["samples"].toInt();
+	}
+
+	QJsonObject manifest;
+	manifest["format"] = "tar";
+	manifest["imageExtension"] = QString(EncodeOperations::extension(m_format.imageCodec)).mid(1);
+	manifest["maskExtension"] = QString(EncodeOperations::extension(m_format.maskCodec)).mid(1);
+	manifest["samples"] = samples;
+	manifest["nextKey"] = static_cast<qint64>(m_nextKey);
+	manifest["shards"] = shards;
+
+	QFile file(m_folderPath + "/manifest.json");
+	if (file.open(QIODevice::WriteOnly))
+	{
+		file.write(QJsonDocument(manifest).toJson());
+	}
+}
+
+ShardReader::ShardReader(const QString& tarPath) :
+	m_tar(tarPath)
+{
+	QFile index(QFileInfo(tarPath).path() + "/" + QFileInfo(tarPath).completeBaseName() + ".idx");
+	if (!m_tar.open(QIODevice::ReadOnly) || !index.open(QIODevice::ReadOnly))
+	{
+		m_tar.close();
+		return;
+	}
+
+	QByteArray table = index.readAll();
+	m_entries.resize(table.size() / sizeof(ShardIndexEntry));
+	std::memcpy(m_entries.data(), table.constData(), m_entries.size() * sizeof(ShardIndexEntry));
+	for (ShardIndexEntry& entry : m_entries)
+	{
+		entry.key = qFromLittleEndian<quint64>(entry.key);
+		entry.imageOffset = qFromLittleEndian<quint64>(entry.imageOffset);
+		entry.imageSize = qFromLittleEndian<quint64>(entry.imageSize);
+		entry.maskOffset = qFromLittleEndian<quint64>(entry.maskOffset);
+		entry.maskSize = qFromLittleEndian<quint64>(entry.maskSize);
+	}
+}
+
+bool ShardReader::isOpen() const
+{
+	return m_tar.isOpen();
+}
+
+int ShardReader::count() const
+{
+	return static_cast<int>(m_entries.size());
+}
+
+uint64_t ShardReader::key(int i) const
+{
+	return m_entries[i].key;
+}
+
+bool ShardReader::read(int i, std::vector<uchar>& image, std::vector<uchar>& mask)
+{
+	if (i < 0 || i >= count())
+	{
+		return false;
+	}
+	const ShardIndexEntry& entry = m_entries[i];
+	return readRange(entry.imageOffset, entry.imageSize, image) && readRange(entry.maskOffset, entry.maskSize, mask);
+}
+
+bool ShardReader::read(int i, cv::Mat& image, cv::Mat& mask)
+{
+	std::vector<uchar> imageData, maskData;
+	if (!read(i, imageData, maskData))
+	{
+		return false;
+	}
+	image = decode(imageData, cv::IMREAD_COLOR);
+	mask = decode(maskData, cv::IMREAD_GRAYSCALE);
+	return !image.empty() && !mask.empty();
+}
+
+bool ShardReader::readRange(uint64_t offset, uint64_t size, std::vector<uchar>& data)
+{
+	data.resize(size);
+	if (!m_tar.seek(offset))
+	{
+		return false;
+	}
+	return m_tar.read(reinterpret_cast<char*>(data.data()), size) == static_cast<qint64>(size);
+}
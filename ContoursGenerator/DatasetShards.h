@@ -0,0 +1,79 @@
+#pragma once
+#include <QFile>
+#include <QJsonArray>
+#include <QString>
+#include <cstdint>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "EncodeOperations.h"
+
+// Sharded dataset layout:
+//   <folder>/shard-000000.tar  samples as tar entries <key>.image.<ext> and <key>.mask.<ext>, appended sequentially
+//   <folder>/shard-000000.idx  offset table of the shard, one ShardIndexEntry per sample
+//   <folder>/manifest.json     shards, sample counts and codecs, rewritten whenever a shard is opened or closed,
+//                              a shard still open is marked "open" and its sample count is only final once closed
+// The tar files can be read by any tar reader (and by WebDataset), the offset tables give random access.
+
+// Offsets point to the entry data inside the tar file, all fields are little endian
+struct ShardIndexEntry
+{
+    uint64_t key;
+    uint64_t imageOffset;
+    uint64_t imageSize;
+    uint64_t maskOffset;
+    uint64_t maskSize;
+};
+
+// Appends encoded samples to shard files of at most maxShardBytes, not thread-safe
+class ShardWriter
+{
+public:
+    ShardWriter(const QString& folderPath, const OutputFormat& format);
+    // Closes the current shard
+    ~ShardWriter();
+
+    // First key after the samples of an existing manifest
+    uint64_t nextKey() const;
+
+    bool append(uint64_t key, const std::vector<uchar>& image, const std::vector<uchar>& mask);
+    // Finish the current shard and rewrite the manifest, the next append starts a new shard
+    void closeShard();
+
+private:
+    bool openShard();
+    bool writeEntry(const QString& name, const std::vector<uchar>& data, uint64_t& dataOffset);
+    void loadManifest();
+    void writeManifest() const;
+
+    QString m_folderPath;
+    OutputFormat m_format;
+
+    QFile m_tar;
+    QFile m_index;
+    int m_shardNumber = 0;
+    int m_shardSamples = 0;
+    uint64_t m_nextKey = 0;
+    QJsonArray m_shards; // manifest entries of the closed shards
+};
+
+// Random access to the samples of one shard through its offset table
+class ShardReader
+{
+public:
+    explicit ShardReader(const QString& tarPath);
+
+    bool isOpen() const;
+    int count() const;
+    uint64_t key(int i) const;
+
+    // Encoded bytes as they were written
+    bool read(int i, std::vector<uchar>& image, std::vector<uchar>& mask);
+    // Decoded image (CV_8UC3) and mask (CV_8UC1)
+    bool read(int i, cv::Mat& image, cv::Mat& mask);
+
+private:
+    bool readRange(uint64_t offset, uint64_t size, std::vector<uchar>& data);
+
+    QFile m_tar;
+    std::vector<ShardIndexEntry> m_entries;
+};
@@ -0,0 +1,246 @@
+#include "DatasetWriter.h"
+#include "ImageGenerator.h"
+#include "SampleStats.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+
+DatasetWriter::DatasetWriter(const QString& folderPath, const OutputFormat& format, int numWriters, int queueCapacity) :
+	m_folderPath(folderPath)
+	, m_format(format)
+	, m_queueCapacity(std::max(1, queueCapacity))
+{
+	if (m_format.shards)
+	{
+		m_shards = std::make_unique<ShardWriter>(m_folderPath, m_format);
+		m_nextIndex = static_cast<int>(m_shards->nextKey());
+	}
+	else
+	{
+		QDir().mkpath(m_folderPath + "/images");
+		QDir().mkpath(m_folderPath + "/masks");
+		m_nextIndex = firstFreeIndex(m_folderPath);
+	}
+
+	if (numWriters <= 0)
+	{
+		// encoding is cheaper than generation, a few writers keep up with all generation workers
+		numWriters = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 4, 1, 4);
+	}
+	m_writers.reserve(numWriters);
+	for (int i = 0; i < numWriters; ++i)
+	{
+		m_writers.emplace_back(&DatasetWriter::writerLoop, this);
+	}
+}
+
+DatasetWriter::~DatasetWriter()
+{
+	finish();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_notEmpty.notify_all();
+	for (auto& writer : m_writers)
+	{
+		writer.join();
+	}
+}
+
+void DatasetWriter::write(const cv::Mat& image, const cv::Mat& mask, SampleStats* stats)
+{
+	write(m_nextIndex++, image, mask, stats);
+}
+
+void DatasetWriter::write(int index, const cv::Mat& image, const cv::Mat& mask, SampleStats* stats)
+{
+	Job job{ index, image, mask, stats };
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_queue.size() < m_queueCapacity; });
+		m_queue.push_back(std::move(job));
+	}
+	m_notEmpty.notify_one();
+}
+
+int DatasetWriter::reserve(int count)
+{
+	return m_nextIndex.fetch_add(count);
+}
+
+void DatasetWriter::writeSplit(int firstIndex, const GenImg& gen, int tileSize, SampleStats* stats)
+{
+	int numX = gen.image.cols / tileSize;
+	int numY = gen.image.rows / tileSize;
+
+	// same order of tiles as before: columns first
+	for (int i = 0; i < numX; ++i)
+	{
+		for (int j = 0; j < numY; ++j)
+		{
+			cv::Rect rect(i * tileSize, j * tileSize, tileSize, tileSize);
+			write(firstIndex + i * numY + j, gen.image(rect), gen.mask(rect), stats);
+		}
+	}
+}
+
+int DatasetWriter::splitCount(const cv::Size& size, int tileSize)
+{
+	return (size.width / tileSize) * (size.height / tileSize);
+}
+
+void DatasetWriter::finish()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this] { return m_queue.empty() && m_busy == 0; });
+	}
+
+	if (m_shards)
+	{
+		std::lock_guard<std::mutex> lock(m_shardMutex);
+		m_shards->closeShard();
+	}
+}
+
+int DatasetWriter::written() const
+{
+	return m_written;
+}
+
+int DatasetWriter::failed() const
+{
+	return m_failed;
+}
+
+void DatasetWriter::writerLoop()
+{
+	std::vector<uchar> buffer; // encoded file, reused between jobs
+	std::vector<uchar> maskBuffer; // encoded mask for shard output
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_notEmpty.wait(lock, [this] { return !m_queue.empty() || m_stopping; });
+			if (m_queue.empty())
+			{
+				break;
+			}
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+			++m_busy;
+		}
+		m_notFull.notify_one();
+
+		// statistics of the job are collected locally and merged into the sample once
+		SampleStats jobStats;
+		SampleStats* stats = job.stats ? &jobStats : nullptr;
+		bool ok;
+		{
+			StageTimer timer(stats, Stage::ENCODE);
+			ok = m_shards ? writeShardJob(job, buffer, maskBuffer, stats) : writeJob(job, buffer, stats);
+		}
+		if (stats)
+		{
+			std::lock_guard<std::mutex> lock(m_statsMutex);
+			job.stats->add(jobStats);
+		}
+
+		if (ok)
+		{
+			++m_written;
+		}
+		else
+		{
+			++m_failed;
+		}
+
+		// release the pixels before reporting the job as done
+		job = Job{};
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_busy;
+		}
+		m_idle.notify_all();
+	}
+}
+
+namespace
+{
+	bool writeFile(const QString& fileName, const std::vector<uchar>& data)
+	{
+		QFile file(fileName);
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			return false;
+		}
+		return file.write(reinterpret_cast<const char*>(data.data()), data.size()) == static_cast<qint64>(data.size());
+	}
+}
+
+bool DatasetWriter::writeJob(const Job& job, std::vector<uchar>& buffer, SampleStats* stats) const
+{
+	QString baseName = QString::number(job.index);
+	QString imageFileName = m_folderPath + "/images/" + baseName + EncodeOperations::extension(m_format.imageCodec);
+	QString maskFileName = m_folderPath + "/masks/" + baseName + EncodeOperations::extension(m_format.maskCodec);
+
+	if (!EncodeOperations::encodeImage(job.image, m_format, buffer) || !writeFile(imageFileName, buffer))
+	{
+		QFile::remove(imageFileName);
+		return false;
+	}
+	int64_t imageBytes = static_cast<int64_t>(buffer.size());
+	if (!EncodeOperations::encodeMask(job.mask, m_format, buffer) || !writeFile(maskFileName, buffer))
+	{
+		QFile::remove(imageFileName);
+		QFile::remove(maskFileName);
+		return false;
+	}
+	if (stats)
+	{
+		stats->bytes += imageBytes + static_cast<int64_t>(buffer.size());
+	}
+	return true;
+}
+
+bool DatasetWriter::writeShardJob(const Job& job, std::vector<uchar>& imageBuffer, std::vector<uchar>& maskBuffer, SampleStats* stats)
+{
+	if (!EncodeOperations::encodeImage(job.image, m_format, imageBuffer) || !EncodeOperations::encodeMask(job.mask, m_format, maskBuffer))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_shardMutex);
+	if (!m_shards->append(job.index, imageBuffer, maskBuffer))
+	{
+		return false;
+	}
+	if (stats)
+	{
+		stats->bytes += static_cast<int64_t>(imageBuffer.size() + maskBuffer.size());
+	}
+	return true;
+}
+
+int DatasetWriter::firstFreeIndex(const QString& folderPath)
+{
+	// one listing per folder, numbering continues after the highest index of either folder
+	int next = 0;
+	for (const QString& subfolder : { QString("images"), QString("masks") })
+	{
+		const QStringList names = QDir(folderPath + "/" + subfolder).entryList(QDir::Files);
+		for (const QString& name : names)
+		{
+			bool ok = false;
+			int index = QFileInfo(name).completeBaseName().toInt(&ok);
+			if (ok && index >= 0)
+			{
+				next = std::max(next, index + 1);
+			}
+		}
+	}
+	return next;
+}
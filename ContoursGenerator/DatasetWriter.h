@@ -0,0 +1,85 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "EncodeOperations.h"
+#include "DatasetShards.h"
+
+struct GenImg;
+struct SampleStats;
+
+// Writes image and mask pairs as <folder>/images/<index>.<ext> and <folder>/masks/<index>.<ext>, encoded as set in OutputFormat,
+// or with OutputFormat::shards into tar shards (see DatasetShards.h).
+// The folder (or the shard manifest) is read once on construction, new indices continue after the highest existing one
+// and are taken from an atomic counter in the order of the write() calls.
+// Encoding and file I/O run on writer threads fed by a bounded queue, write() blocks only when the queue is full.
+// Queued pairs share the pixels of the caller, which must not modify them afterwards
+// (a new sample in a new cv::Mat is fine, the queue keeps the old buffer alive).
+class DatasetWriter
+{
+public:
+    // numWriters <= 0 picks a default, queueCapacity counts image pairs
+    DatasetWriter(const QString& folderPath, const OutputFormat& format = OutputFormat(), int numWriters = 0, int queueCapacity = 128);
+    // Waits for all queued pairs
+    ~DatasetWriter();
+
+    // With stats the encoding time and the bytes written are added to it once the pair is written,
+    // the stats must outlive finish()
+    void write(const cv::Mat& image, const cv::Mat& mask, SampleStats* stats = nullptr);
+    // Explicit index, e.g. from reserve(), the counter is not advanced
+    void write(int index, const cv::Mat& image, const cv::Mat& mask, SampleStats* stats = nullptr);
+    // Takes count consecutive indices from the counter and returns the first one
+    int reserve(int count);
+    // Split into tileSize x tileSize tiles written at firstIndex, firstIndex + 1, ... (see splitCount()),
+    // the tiles are views of the sample
+    void writeSplit(int firstIndex, const GenImg& gen, int tileSize = 256, SampleStats* stats = nullptr);
+    // Number of tiles writeSplit() writes for a sample of this size
+    static int splitCount(const cv::Size& size, int tileSize = 256);
+    // Blocks until all queued pairs are written and closes the current shard, the writer can be used again afterwards
+    void finish();
+
+    int written() const;
+    int failed() const;
+
+protected:
+    struct Job
+    {
+        int index;
+        cv::Mat image;
+        cv::Mat mask;
+        SampleStats* stats;
+    };
+
+    void writerLoop();
+    bool writeJob(const Job& job, std::vector<uchar>& buffer, SampleStats* stats) const;
+    bool writeShardJob(const Job& job, std::vector<uchar>& imageBuffer, std::vector<uchar>& maskBuffer, SampleStats* stats);
+    static int firstFreeIndex(const QString& folderPath);
+
+private:
+    QString m_folderPath;
+    OutputFormat m_format;
+    std::atomic<int> m_nextIndex{ 0 };
+    std::atomic<int> m_written{ 0 };
+    std::atomic<int> m_failed{ 0 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_idle;
+    std::deque<Job> m_queue;
+    size_t m_queueCapacity;
+    int m_busy = 0; // jobs taken from the queue and not written yet
+    bool m_stopping = false;
+    std::vector<std::thread> m_writers;
+    std::mutex m_statsMutex; // tiles of one sample may be written by several writers
+
+    // shard output only, appends are serialized, encoding is not
+    std::unique_ptr<ShardWriter> m_shards;
+    std::mutex m_shardMutex;
+};
@@ -2,18 +2,16 @@
 #include "RandomGenerator.h"
 #include <qpainter.h>
 #include <ContoursOperations.h>
-#include <qpainterpath.h>
+#include "LabelPlacer.h"
+#include <qfontdatabase.h>
 
-void DrawOperations::drawRandomWell(QPixmap& image, const WellParams& params)
+void DrawOperations::drawRandomWell(QPaintDevice& device, const WellParams& params, RandomGenerator& gen)
 {
-	int width = image.width();
-	int height = image.height();
 	int radius = params.radius;
 
-	auto& gen = RandomGenerator::instance();
-	QPoint wellPt = gen.getRandomPoint(image.width(), image.height());
+	QPoint wellPt = gen.getRandomPoint(device.width(), device.height());
 
-	QPainter painter(&image);
+	QPainter painter(&device);
 
 	int outline = params.outline;
 	if (outline > 0)
@@ -32,11 +30,12 @@ void DrawOperations::drawRandomWell(QPixmap& image, const WellParams& params)
 
 	if (params.drawText)
 	{
-		drawWellTitle(painter, wellPt, params);
+		auto lock = lockTextRendering();
+		drawWellTitle(painter, wellPt, params, gen);
 	}
 }
 
-void DrawOperations::drawWellTitle(QPainter& painter, const QPoint& wellPt, const WellParams& params)
+void DrawOperations::drawWellTitle(QPainter& painter, const QPoint& wellPt, const WellParams& params, RandomGenerator& gen)
 {
 	int offset = params.radius + params.offset;
 	QPoint textPt(wellPt.x() + offset, wellPt.y() - offset);
@@ -47,96 +46,40 @@ void DrawOperations::drawWellTitle(QPainter& painter, const QPoint& wellPt, cons
 
 	painter.setPen(QPen());
 
-	short idWell = RandomGenerator::instance().getRandomInt(999);
+	short idWell = gen.getRandomInt(999);
 
 	QString idWellStr = QString::number(idWell);
 
 	painter.drawText(textPt, idWellStr);
 }
 
-void DrawOperations::drawContourValues(QPainter& painter, const Contour& contour, QColor textColor, const QFont& font, int minTextDistance)
+int DrawOperations::drawContourValues(QPainter& painter, const Contour& contour, QColor textColor, LabelPlacer& placer)
 {
-	painter.setPen(textColor);
-	painter.setFont(font);
+	auto lock = lockTextRendering();
 
-	QPainterPath clipPath;
+	painter.setPen(textColor);
+	painter.setFont(placer.font());
 
-	// Draw text along the contour points
-	// Calc the text rotation angle according to the slope of the line
-	// Add rotated bounding rect of text to the clip path
+	PlacedLabels placed = placer.place(contour);
 
-	double minDist = minTextDistance;
-	cv::Point prevPt;
-	for (size_t i = 0; i < contour.points.size(); i++)
+	// Draw text at the positions picked by the placer, rotated along the contour
+	for (const ContourLabel& label : placed.labels)
 	{
-		cv::Point pt1_cv = contour.points[i];
-		cv::Point pt2_cv = contour.points[(i + 1) % contour.points.size()];
-
-		if(i != 0)
-		{
-			double dist = cv::norm(pt1_cv - prevPt);
-			if (dist < minDist)
-			{
-				continue;
-			}
-			double distEnd = cv::norm(pt1_cv - contour.points.back());
-			if (distEnd < minDist)
-			{
-				break;
-			}
-		}
-		prevPt = pt1_cv;
-
-		QPoint pt1 = { pt1_cv.x, pt1_cv.y };
-		QPoint pt2 = { pt2_cv.x, pt2_cv.y };
-
-		QLineF line(pt1, pt2);
-		double angle = line.angle();
-
-		if (angle > 180) 
-		{
-			angle -= 180;
-		}
-
-		if (angle > 90)
-		{
-			angle -= 180;
-		}
-
-		angle = 360 - angle;
-
-		QFont rotatedFont = font;
-		rotatedFont.setPointSize(10);
-		rotatedFont.setBold(true);
-
-		QRectF textRect = painter.boundingRect(QRect(), Qt::AlignCenter, QString::number(contour.depth + 1));
-
-		QTransform transform;
-		transform.translate(pt1.x(), pt1.y());
-		transform.rotate(angle);
-
-		QRectF rotatedRect = transform.mapRect(textRect);
-
-		clipPath.addRect(rotatedRect);
-
 		painter.save();
-		painter.translate(pt1);
-		//painter.translate(-textRect.bottomRight());
-		painter.rotate(angle);
-
-		painter.drawText(textRect, Qt::AlignCenter, QString::number(contour.depth + 1));
-		//painter.drawRect(textRect);
+		painter.translate(label.position);
+		painter.rotate(label.angle);
+		painter.drawText(label.textRect, Qt::AlignCenter, label.text);
 		painter.restore();
-		painter.resetTransform();
 	}
 
-	QPainterPath clipInv;
-	clipInv.addRect({0,0,INT_MAX,INT_MAX});
-	clipInv -= clipPath;
-
-	painter.setClipPath(clipInv);
+	// Draw the contour line with gaps under the labels
+	painter.setPen(QColor(Qt::black));
+	for (const QPolygonF& segment : placed.segments)
+	{
+		painter.drawPolyline(segment);
+	}
 
-	drawContour(painter, contour, Qt::black);
+	return static_cast<int>(placed.labels.size());
 }
 
 void DrawOperations::drawContour(QPainter& painter, const Contour& contour, QColor color)
@@ -152,3 +95,14 @@ void DrawOperations::drawContour(QPainter& painter, const Contour& contour, QCol
 
 	painter.drawPolyline(pts.data(), contour.points.size());
 }
+
+std::unique_lock<std::mutex> DrawOperations::lockTextRendering()
+{
+	static std::mutex mutex;
+	static const bool threaded = QFontDatabase::supportsThreadedFontRendering();
+	if (threaded)
+	{
+		return std::unique_lock<std::mutex>(mutex, std::defer_lock);
+	}
+	return std::unique_lock<std::mutex>(mutex);
+}
@@ -1,7 +1,10 @@
 #pragma once
 #include <qimage.h>
+#include <mutex>
 
 struct Contour;
+class RandomGenerator;
+class LabelPlacer;
 
 struct WellParams
 {
@@ -14,11 +17,17 @@ struct WellParams
 };
 
 
+// Drawing targets any QPaintDevice. QImage can be painted on worker threads and under the offscreen platform,
+// QPixmap only on the GUI thread.
 namespace DrawOperations
 {
-	void drawRandomWell(QPixmap& image, const WellParams& params);
-	void drawWellTitle(QPainter& painter, const QPoint& wellPt, const WellParams& params);
-	void drawContourValues(QPainter& painter, const Contour& contour, QColor textColor, const QFont& font, int minTextDistance);
+	void drawRandomWell(QPaintDevice& device, const WellParams& params, RandomGenerator& gen);
+	void drawWellTitle(QPainter& painter, const QPoint& wellPt, const WellParams& params, RandomGenerator& gen);
+	// Labels of all contours of an image must come from the same placer, so they do not overlap. Returns the number of labels drawn
+	int drawContourValues(QPainter& painter, const Contour& contour, QColor textColor, LabelPlacer& placer);
 	void drawContour(QPainter& painter, const Contour& contour, QColor color);
+	// Hold while drawing text. Serializes text rendering if the platform cannot render fonts outside of the GUI thread,
+	// otherwise the lock is not taken.
+	std::unique_lock<std::mutex> lockTextRendering();
 };
 
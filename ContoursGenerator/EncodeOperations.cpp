@@ -0,0 +1,138 @@
+#include "EncodeOperations.h"
+#include <opencv2/imgcodecs.hpp>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+bool EncodeOperations::encodeImage(const cv::Mat& image, const OutputFormat& format, std::vector<uchar>& buffer)
+{
+	if (format.imageCodec == ImageCodec::PNG)
+	{
+		return cv::imencode(".png", image, buffer, { cv::IMWRITE_PNG_COMPRESSION, format.pngCompression });
+	}
+	return cv::imencode(".jpg", image, buffer, { cv::IMWRITE_JPEG_QUALITY, format.jpegQuality });
+}
+
+bool EncodeOperations::encodeMask(const cv::Mat& mask, const OutputFormat& format, std::vector<uchar>& buffer)
+{
+	switch (format.maskCodec)
+	{
+	case MaskCodec::PNG:
+		return cv::imencode(".png", mask, buffer, { cv::IMWRITE_PNG_COMPRESSION, format.pngCompression });
+	case MaskCodec::PNG_1BIT:
+	{
+		// the bilevel writer expects 0 and 255 only
+		cv::Mat binary = mask >= 128;
+		return cv::imencode(".png", binary, buffer, { cv::IMWRITE_PNG_BILEVEL, 1, cv::IMWRITE_PNG_COMPRESSION, format.pngCompression });
+	}
+	case MaskCodec::NPY:
+		encodeNpy(mask, buffer);
+		return true;
+	default:
+		return cv::imencode(".jpg", mask, buffer, { cv::IMWRITE_JPEG_QUALITY, format.jpegQuality });
+	}
+}
+
+void EncodeOperations::encodeNpy(const cv::Mat& mat, std::vector<uchar>& buffer)
+{
+	CV_Assert(mat.depth() == CV_8U);
+
+	// format version 1.0: magic, version, little endian header length, header dict padded with spaces to 64 bytes
+	std::string shape = "(" + std::to_string(mat.rows) + ", " + std::to_string(mat.cols);
+	shape += mat.channels() > 1 ? ", " + std::to_string(mat.channels()) + ")" : ")";
+	std::string header = "{'descr': '|u1', 'fortran_order': False, 'shape': " + shape + ", }";
+	const size_t prefixSize = 10;
+	size_t total = prefixSize + header.size() + 1;
+	header.append((64 - total % 64) % 64, ' ');
+	header.push_back('\n');
+
+	size_t rowSize = static_cast<size_t>(mat.cols) * mat.elemSize();
+	buffer.clear();
+	buffer.reserve(prefixSize + header.size() + rowSize * mat.rows);
+
+	const char magic[] = "\x93NUMPY";
+	buffer.insert(buffer.end(), magic, magic + 6);
+	buffer.push_back(1);
+	buffer.push_back(0);
+	buffer.push_back(static_cast<uchar>(header.size() & 0xff));
+	buffer.push_back(static_cast<uchar>(header.size() >> 8));
+	buffer.insert(buffer.end(), header.begin(), header.end());
+
+	for (int row = 0; row < mat.rows; ++row)
+	{
+		const uchar* data = mat.ptr<uchar>(row);
+		buffer.insert(buffer.end(), data, data + rowSize);
+	}
+}
+
+cv::Mat EncodeOperations::decodeNpy(const std::vector<uchar>& buffer)
+{
+	const size_t prefixSize = 10;
+	if (buffer.size() < prefixSize || std::memcmp(buffer.data(), "\x93NUMPY", 6) != 0 || buffer[6] != 1)
+	{
+		return cv::Mat();
+	}
+	size_t headerSize = buffer[8] | (static_cast<size_t>(buffer[9]) << 8);
+	if (buffer.size() < prefixSize + headerSize)
+	{
+		return cv::Mat();
+	}
+	std::string header(buffer.begin() + prefixSize, buffer.begin() + prefixSize + headerSize);
+	if (header.find("'|u1'") == std::string::npos || header.find("'fortran_order': False") == std::string::npos)
+	{
+		return cv::Mat();
+	}
+
+	// shape is (rows, cols) or (rows, cols, channels)
+	int dims[3] = { 0, 0, 1 };
+	size_t open = header.find('(', header.find("'shape'"));
+	size_t close = header.find(')', open);
+	if (open == std::string::npos || close == std::string::npos
+		|| std::sscanf(header.substr(open, close - open + 1).c_str(), "(%d, %d, %d)", &dims[0], &dims[1], &dims[2]) < 2)
+	{
+		return cv::Mat();
+	}
+
+	// positive dims whose product fits the payload, compared by division so the product cannot overflow
+	size_t payloadSize = buffer.size() - prefixSize - headerSize;
+	if (dims[0] <= 0 || dims[1] <= 0 || dims[2] <= 0 || dims[2] > CV_CN_MAX
+		|| static_cast<size_t>(dims[1]) > payloadSize / static_cast<size_t>(dims[0])
+		|| static_cast<size_t>(dims[2]) > payloadSize / (static_cast<size_t>(dims[0]) * dims[1]))
+	{
+		return cv::Mat();
+	}
+	size_t dataSize = static_cast<size_t>(dims[0]) * dims[1] * dims[2];
+	cv::Mat mat(dims[0], dims[1], CV_8UC(dims[2]));
+	std::memcpy(mat.data, buffer.data() + prefixSize + headerSize, dataSize);
+	return mat;
+}
+
+bool OutputFormat::operator==(const OutputFormat& other) const
+{
+	return imageCodec == other.imageCodec && maskCodec == other.maskCodec && jpegQuality == other.jpegQuality
+		&& pngCompression == other.pngCompression && shards == other.shards && shardBytes == other.shardBytes;
+}
+
+bool OutputFormat::operator!=(const OutputFormat& other) const
+{
+	return !(*this == other);
+}
+
+const char* EncodeOperations::extension(ImageCodec codec)
+{
+	return codec == ImageCodec::PNG ? ".png" : ".jpg";
+}
+
+const char* EncodeOperations::extension(MaskCodec codec)
+{
+	switch (codec)
+	{
+	case MaskCodec::PNG:
+	case MaskCodec::PNG_1BIT:
+		return ".png";
+	case MaskCodec::NPY:
+		return ".npy";
+	default:
+		return ".jpg";
+	}
+}
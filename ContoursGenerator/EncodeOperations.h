@@ -0,0 +1,46 @@
+#pragma once
+#include <QtGlobal>
+#include <vector>
+#include <opencv2/core.hpp>
+
+enum class ImageCodec
+{
+    JPEG,
+    PNG
+};
+
+enum class MaskCodec
+{
+    JPEG,
+    PNG,
+    PNG_1BIT, // thresholded at 128 and packed to 1 bit per pixel
+    NPY // raw uint8 numpy array of shape (rows, cols)
+};
+
+// Codecs of the image and mask streams of a dataset
+struct OutputFormat
+{
+    ImageCodec imageCodec = ImageCodec::JPEG;
+    MaskCodec maskCodec = MaskCodec::JPEG;
+    int jpegQuality = 75; // 0..100, the default matches the previous QImage::save output
+    int pngCompression = 3; // zlib level 0..9
+    bool shards = false; // pack samples into tar shards with an offset table instead of one file per image, see DatasetShards.h
+    qint64 shardBytes = qint64(1) << 30; // a new shard starts when the next sample would exceed this size
+
+    bool operator==(const OutputFormat& other) const;
+    bool operator!=(const OutputFormat& other) const;
+};
+
+// Encoding straight from cv::Mat to memory, rows of ROIs are handled without copying the whole image
+namespace EncodeOperations
+{
+    bool encodeImage(const cv::Mat& image, const OutputFormat& format, std::vector<uchar>& buffer);
+    bool encodeMask(const cv::Mat& mask, const OutputFormat& format, std::vector<uchar>& buffer);
+    void encodeNpy(const cv::Mat& mat, std::vector<uchar>& buffer);
+    // Reads what encodeNpy writes (uint8, C order), returns an empty mat for anything else
+    cv::Mat decodeNpy(const std::vector<uchar>& buffer);
+
+    // File extensions with the leading dot
+    const char* extension(ImageCodec codec);
+    const char* extension(MaskCodec codec);
+};
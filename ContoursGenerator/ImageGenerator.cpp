@@ -0,0 +1,469 @@
+#include "ImageGenerator.h"
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "LabelPlacer.h"
+#include "RandomGenerator.h"
+#include "SampleStats.h"
+#include <opencv2/ximgproc.hpp>
+#include <qpainter.h>
+#include <algorithm>
+
+GenImg ImageGenerator::generateImage(const GenerationParams& params, const WellParams& wellParams, RandomGenerator& gen, const std::atomic<bool>* canceled,
+	SampleStats* stats)
+{
+	auto isCanceled = [canceled]() { return canceled && canceled->load(std::memory_order_relaxed); };
+
+	cv::Mat isolines; // isolines mat
+	cv::Mat mask; // mask mat
+	cv::Mat image; // visual representation, drawn in place by OpenCV and QPainter
+	cv::Mat canvas; // view of the image without the cropped border
+
+	int cropSize = 1;
+
+	if (params.generateIsolines)
+	{
+		std::vector<Contour> contours;
+		cv::Size contoursSize; // size of the cropped image the contours live in
+
+		if (params.engine == ContourEngine::MARCHING_SQUARES)
+		{
+			cv::Mat field;
+			{
+				StageTimer timer(stats, Stage::NOISE);
+				field = ContoursOperations::generateField(params, gen);
+			}
+
+			StageTimer timer(stats, Stage::TRACING);
+
+			// isolines at every integer level of the field
+			std::vector<ContoursOperations::Isoline> lines = ContoursOperations::traceIsolines(field, 1.0);
+
+			// mask lines keep the sub-pixel positions
+			const int shift = 4;
+			mask = cv::Mat::zeros(field.size(), CV_8UC1);
+			std::vector<cv::Point> pts;
+			for (const auto& line : lines)
+			{
+				pts.clear();
+				for (const auto& pt : line.points)
+				{
+					pts.emplace_back(cvRound(pt.x * (1 << shift)), cvRound(pt.y * (1 << shift)));
+				}
+				cv::polylines(mask, pts, false, cv::Scalar(255), 1, cv::LINE_8, shift);
+			}
+
+			// crop by 1 pixel
+			contoursSize = cv::Size(field.cols - 2 * cropSize, field.rows - 2 * cropSize);
+			ContoursOperations::isolinesToContours(lines, contoursSize, cv::Point(cropSize, cropSize), contours);
+		}
+		else
+		{
+			{
+				cv::Mat field;
+				{
+					StageTimer timer(stats, Stage::NOISE);
+					field = ContoursOperations::generateField(params, gen);
+				}
+				StageTimer timer(stats, Stage::SOBEL);
+				isolines = ContoursOperations::generateIsolines(field);
+			}
+
+			mask = cv::Scalar(255) - isolines;
+
+			// apply thinning
+			cv::Mat thinned;
+			{
+				StageTimer timer(stats, Stage::THINNING);
+				cv::ximgproc::thinning(mask, thinned, cv::ximgproc::THINNING_GUOHALL);
+			}
+
+			// crop by 1 pixel
+			cv::Rect cropRect(cropSize, cropSize, thinned.cols - 2 * cropSize, thinned.rows - 2 * cropSize);
+			thinned = thinned(cropRect);
+			contoursSize = thinned.size();
+
+			// Find contours
+			StageTimer timer(stats, Stage::TRACING);
+			ContoursOperations::findContours(thinned, contours);
+		}
+
+		if (stats)
+		{
+			stats->contours += static_cast<int64_t>(contours.size());
+			for (const auto& contour : contours)
+			{
+				stats->points += static_cast<int64_t>(contour.points.size());
+			}
+		}
+
+		if (isCanceled())
+		{
+			return GenImg{};
+		}
+
+		image.create(mask.size(), CV_8UC3);
+		canvas = image(cv::Rect(cv::Point(cropSize, cropSize), contoursSize));
+
+		cv::Mat contours_mat;
+		{
+			StageTimer timer(stats, Stage::DEPTH);
+
+			// Label map of contour values
+			contours_mat = ContoursOperations::labelContours(contours, contoursSize);
+
+			// Find depth
+			ContoursOperations::findDepth(contours_mat, contours);
+		}
+
+		if (isCanceled())
+		{
+			return GenImg{};
+		}
+
+		{
+			StageTimer timer(stats, Stage::FILL);
+
+			// Draw contours
+			canvas.setTo(params.fillContours ? cv::Scalar(0, 0, 0) : cv::Scalar(255, 255, 255));
+			for (size_t i = 0; i < contours.size(); i++)
+			{
+				for (size_t j = 0; j < contours[i].points.size(); ++j)
+				{
+					cv::Scalar color = contours[i].isClosed ? cv::Scalar(75, 75, 75) : cv::Scalar(150, 100, 150);
+					canvas.at<cv::Vec3b>(contours[i].points[j]) = cv::Vec3b(color[0], color[1], color[2]);
+				}
+			}
+
+			if (params.fillContours)
+			{
+				// Fill areas
+				ContoursOperations::fillContours(contours_mat, contours, canvas);
+			}
+		}
+
+		if (isCanceled())
+		{
+			return GenImg{};
+		}
+
+		{
+			StageTimer timer(stats, Stage::INPAINT);
+
+			// Inpaint contours on drawing
+			cv::Mat maskInpaint = cv::Mat::zeros(contoursSize, CV_8UC1);
+			for (size_t i = 0; i < contours.size(); i++)
+			{
+				const Contour& c = contours[i];
+				for (size_t j = 0; j < c.points.size(); ++j)
+				{
+					maskInpaint.at<uchar>(c.points[j]) = 255;
+				}
+			}
+
+			// Inpaint
+			if (params.inpaintTelea)
+			{
+				cv::inpaint(canvas, maskInpaint, canvas, 3, cv::INPAINT_TELEA);
+			}
+			else
+			{
+				ContoursOperations::fillFromNeighbours(canvas, maskInpaint);
+			}
+		}
+
+		if (isCanceled())
+		{
+			return GenImg{};
+		}
+
+		// Draw contours 
+		StageTimer timer(stats, Stage::LABELS);
+		QImage canvasView = utils::matView(canvas);
+		QFont font;
+		QPainter painter(&canvasView);
+		LabelPlacer placer(font, &canvasView, params.textDistance);
+
+		for (const auto& contour : contours)
+		{
+			if (isCanceled())
+			{
+				return GenImg{};
+			}
+
+			if (params.drawValues)
+			{
+				int labels = DrawOperations::drawContourValues(painter, contour, QColor(Qt::black), placer);
+				if (stats)
+				{
+					stats->labels += labels;
+				}
+			}
+			else
+			{
+				DrawOperations::drawContour(painter, contour, QColor(Qt::black));
+			}
+		}
+	}
+	else
+	{
+		mask = cv::Mat::zeros(params.height, params.width, CV_8UC1);
+		image.create(mask.size(), CV_8UC3);
+		// an image below 3 pixels has nothing inside the border, it is drawn without one
+		if (std::min(mask.rows, mask.cols) <= 2 * cropSize)
+		{
+			cropSize = 0;
+		}
+		canvas = image(cv::Rect(cropSize, cropSize, mask.cols - 2 * cropSize, mask.rows - 2 * cropSize));
+		canvas.setTo(cv::Scalar(0, 0, 0));
+	}
+
+	if (isCanceled())
+	{
+		return GenImg{};
+	}
+
+	if (params.generateWells)
+	{
+		StageTimer timer(stats, Stage::WELLS);
+
+		// one color for all wells of the image
+		WellParams sampleWellParams = wellParams;
+		sampleWellParams.color = gen.getRandomColor();
+		QImage canvasView = utils::matView(canvas);
+		for (int i = 0; i < params.numOfWells; ++i)
+		{
+			DrawOperations::drawRandomWell(canvasView, sampleWellParams, gen);
+		}
+	}
+
+	// restore the cropped border around the canvas
+	StageTimer timer(stats, Stage::INPAINT);
+	if (params.inpaintTelea)
+	{
+		cv::Mat borderMask(image.size(), CV_8UC1, cv::Scalar(255));
+		borderMask(cv::Rect(cropSize, cropSize, canvas.cols, canvas.rows)) = cv::Scalar(0);
+		image.setTo(cv::Scalar(255, 255, 255), borderMask);
+		cv::inpaint(image, borderMask, image, 3, cv::INPAINT_TELEA);
+	}
+	else
+	{
+		// the border is only 1 pixel wide, repeating the edge pixels is enough
+		for (int i = 0; i < cropSize; ++i)
+		{
+			image.row(cropSize).copyTo(image.row(i));
+			image.row(image.rows - 1 - cropSize).copyTo(image.row(image.rows - 1 - i));
+		}
+		for (int i = 0; i < cropSize; ++i)
+		{
+			image.col(cropSize).copyTo(image.col(i));
+			image.col(image.cols - 1 - cropSize).copyTo(image.col(image.cols - 1 - i));
+		}
+	}
+
+	GenImg result{ image, mask };
+	return result;
+}
+
+namespace
+{
+	// Color of the band between two levels of the field, the band colors span the value range 0..mul
+	template <class Float>
+	void fillBands(const cv::Mat& field, const std::vector<cv::Vec3b>& colors, cv::Mat& image)
+	{
+		const int last = static_cast<int>(colors.size()) - 1;
+		for (int j = 0; j < field.rows; ++j)
+		{
+			const Float* fieldRow = field.ptr<Float>(j);
+			cv::Vec3b* imageRow = image.ptr<cv::Vec3b>(j);
+			for (int i = 0; i < field.cols; ++i)
+			{
+				int band = static_cast<int>(std::floor(fieldRow[i]));
+				imageRow[i] = colors[std::clamp(band, 0, last)];
+			}
+		}
+	}
+}
+
+GenImg ImageGenerator::generateTile(const GenerationParams& params, const WellParams& wellParams, const cv::Mat& field, const cv::Rect& core, RandomGenerator& gen,
+	int minContours, const std::atomic<bool>* canceled, SampleStats* stats)
+{
+	auto isCanceled = [canceled]() { return canceled && canceled->load(std::memory_order_relaxed); };
+
+	cv::Mat image; // tile with the margin
+	cv::Mat mask;
+	cv::Rect local(cv::Point(0, 0), core.size()); // core inside image and mask
+
+	if (params.generateIsolines)
+	{
+		cv::Rect region = cv::Rect(core.x - kTileMargin, core.y - kTileMargin, core.width + 2 * kTileMargin, core.height + 2 * kTileMargin)
+			& cv::Rect(0, 0, field.cols, field.rows);
+		local = core - region.tl();
+		cv::Mat tileField = field(region);
+
+		// isolines at every integer level of the field
+		std::vector<ContoursOperations::Isoline> lines;
+		std::vector<Contour> contours;
+		{
+			StageTimer timer(stats, Stage::TRACING);
+			lines = ContoursOperations::traceIsolines(tileField, 1.0);
+			ContoursOperations::isolinesToContours(lines, tileField.size(), cv::Point(0, 0), contours);
+		}
+
+		if (stats)
+		{
+			stats->contours += static_cast<int64_t>(contours.size());
+			for (const auto& contour : contours)
+			{
+				stats->points += static_cast<int64_t>(contour.points.size());
+			}
+		}
+
+		if (minContours > 0)
+		{
+			int crossing = static_cast<int>(std::count_if(contours.begin(), contours.end(),
+				[&local](const Contour& c) { return (c.boundingRect & local).area() > 0; }));
+			if (crossing < minContours)
+			{
+				return GenImg{};
+			}
+		}
+
+		if (isCanceled())
+		{
+			return GenImg{};
+		}
+
+		{
+			StageTimer timer(stats, Stage::TRACING);
+
+			// mask lines keep the sub-pixel positions
+			const int shift = 4;
+			mask = cv::Mat::zeros(tileField.size(), CV_8UC1);
+			std::vector<cv::Point> pts;
+			for (const auto& line : lines)
+			{
+				pts.clear();
+				for (const auto& pt : line.points)
+				{
+					pts.emplace_back(cvRound(pt.x * (1 << shift)), cvRound(pt.y * (1 << shift)));
+				}
+				cv::polylines(mask, pts, false, cv::Scalar(255), 1, cv::LINE_8, shift);
+			}
+		}
+
+		image.create(tileField.size(), CV_8UC3);
+		{
+			StageTimer timer(stats, Stage::FILL);
+			if (params.fillContours)
+			{
+				// the nesting depth would need the whole map, bands get the colors fillContours gives to depths
+				int bands = std::max(params.mul, 1);
+				ColorScaler scaler(0, bands, cv::Scalar(18, 185, 27), cv::Scalar(20, 20, 185));
+				std::vector<cv::Vec3b> colors(bands + 1);
+				for (size_t i = 0; i < colors.size(); ++i)
+				{
+					cv::Scalar color = scaler.getColor(static_cast<double>(i));
+					colors[i] = cv::Vec3b(cv::saturate_cast<uchar>(color[0]), cv::saturate_cast<uchar>(color[1]), cv::saturate_cast<uchar>(color[2]));
+				}
+
+				if (tileField.depth() == CV_32F)
+				{
+					fillBands<float>(tileField, colors, image);
+				}
+				else
+				{
+					fillBands<double>(tileField, colors, image);
+				}
+			}
+			else
+			{
+				image.setTo(cv::Scalar(255, 255, 255));
+			}
+		}
+
+		for (auto& contour : contours)
+		{
+			// labels show the level
+			contour.depth = cvRound(contour.level) - 1;
+		}
+
+		StageTimer timer(stats, Stage::LABELS);
+		QImage imageView = utils::matView(image);
+		QFont font;
+		QPainter painter(&imageView);
+		LabelPlacer placer(font, &imageView, params.textDistance);
+		// a label cut by the tile border would not continue in the neighbour
+		placer.setBounds(QRectF(local.x, local.y, local.width, local.height));
+
+		for (const auto& contour : contours)
+		{
+			if (isCanceled())
+			{
+				return GenImg{};
+			}
+
+			if (params.drawValues)
+			{
+				int labels = DrawOperations::drawContourValues(painter, contour, QColor(Qt::black), placer);
+				if (stats)
+				{
+					stats->labels += labels;
+				}
+			}
+			else
+			{
+				DrawOperations::drawContour(painter, contour, QColor(Qt::black));
+			}
+		}
+	}
+	else
+	{
+		if (minContours > 0)
+		{
+			return GenImg{};
+		}
+		image = cv::Mat::zeros(core.size(), CV_8UC3);
+		mask = cv::Mat::zeros(core.size(), CV_8UC1);
+	}
+
+	// the margin is dropped here, the views keep the whole buffers alive
+	GenImg result{ image(local), mask(local) };
+
+	if (params.generateWells)
+	{
+		StageTimer timer(stats, Stage::WELLS);
+
+		// wells of a tile stay inside of it
+		WellParams tileWellParams = wellParams;
+		tileWellParams.color = gen.getRandomColor();
+		QImage coreView = utils::matView(result.image);
+		for (int i = 0; i < params.numOfWells; ++i)
+		{
+			DrawOperations::drawRandomWell(coreView, tileWellParams, gen);
+		}
+	}
+
+	return result;
+}
+
+QImage utils::matView(cv::Mat& mat)
+{
+	CV_Assert(mat.type() == CV_8UC3 || mat.type() == CV_8UC1);
+	QImage::Format format = mat.type() == CV_8UC3 ? QImage::Format_BGR888 : QImage::Format_Grayscale8;
+	return QImage(mat.data, mat.cols, mat.rows, static_cast<int>(mat.step), format);
+}
+
+QImage utils::matView(const cv::Mat& mat)
+{
+	CV_Assert(mat.type() == CV_8UC3 || mat.type() == CV_8UC1);
+	QImage::Format format = mat.type() == CV_8UC3 ? QImage::Format_BGR888 : QImage::Format_Grayscale8;
+	return QImage(const_cast<const uchar*>(mat.data), mat.cols, mat.rows, static_cast<int>(mat.step), format);
+}
+
+cv::Mat utils::imageView(QImage& image)
+{
+	CV_Assert(image.format() == QImage::Format_BGR888 || image.format() == QImage::Format_Grayscale8);
+	int type = image.format() == QImage::Format_BGR888 ? CV_8UC3 : CV_8UC1;
+	// bits() detaches a shared QImage, the view then points to memory owned by this image only
+	return cv::Mat(image.height(), image.width(), type, image.bits(), image.bytesPerLine());
+}
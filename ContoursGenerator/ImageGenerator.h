@@ -0,0 +1,50 @@
+#pragma once
+#include <QImage>
+#include <opencv2/opencv.hpp>
+#include <atomic>
+
+struct WellParams;
+struct GenerationParams;
+class RandomGenerator;
+struct SampleStats;
+
+// Generated sample, image is CV_8UC3 (BGR) and mask is CV_8UC1 of the same size
+struct GenImg
+{
+    cv::Mat image;
+    cv::Mat mask;
+};
+
+// Views between cv::Mat and QImage share the pixels, nothing is copied.
+// The owner of the buffer must outlive the view and must not be reallocated while the view is used.
+// Copy the view (cv::Mat::clone, QImage::copy) to keep the pixels longer.
+namespace utils
+{
+    // CV_8UC3 as Format_BGR888, CV_8UC1 as Format_Grayscale8, ROIs keep their row stride
+    QImage matView(cv::Mat& mat);
+    // read-only view, painting on it detaches a copy
+    QImage matView(const cv::Mat& mat);
+    // Format_BGR888 as CV_8UC3, Format_Grayscale8 as CV_8UC1
+    cv::Mat imageView(QImage& image);
+}
+
+namespace ImageGenerator
+{
+    // Run the whole generation pipeline (isolines, fill, values, wells) without any widget.
+    // All randomness of the sample is taken from gen, the same seed gives the same image.
+    // canceled is checked between stages, a canceled generation returns an empty GenImg.
+    // With stats the stage times and counters of the sample are added to it.
+    GenImg generateImage(const GenerationParams& params, const WellParams& wellParams, RandomGenerator& gen, const std::atomic<bool>* canceled = nullptr,
+        SampleStats* stats = nullptr);
+
+    // Field margin used around a tile, lines crossing the tile border are traced the same way by both neighbours
+    const int kTileMargin = 4;
+
+    // Render the part core of a field (see ContoursOperations::generateField) that is larger than the tile, for tiles of a big map.
+    // Marching squares isolines are traced on core plus kTileMargin, regions are filled by the level band,
+    // labels show the level and stay inside the tile. Wells are taken from gen.
+    // Tiles crossed by fewer than minContours isolines are skipped early and return an empty GenImg, as does a canceled one.
+    // With stats the stage times and counters of the tile are added to it, the field is timed by the caller.
+    GenImg generateTile(const GenerationParams& params, const WellParams& wellParams, const cv::Mat& field, const cv::Rect& core, RandomGenerator& gen,
+        int minContours = 0, const std::atomic<bool>* canceled = nullptr, SampleStats* stats = nullptr);
+};
@@ -0,0 +1,269 @@
+#include "LabelPlacer.h"
+#include "ContoursOperations.h"
+#include <QLineF>
+#include <QPaintDevice>
+#include <QTransform>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// the slot is moved forward along the contour this many times before the label is dropped
+	const int kPlacementAttempts = 3;
+
+	// Keep the text readable: never upside down
+	double uprightAngle(double angle)
+	{
+		if (angle > 180)
+		{
+			angle -= 180;
+		}
+
+		if (angle > 90)
+		{
+			angle -= 180;
+		}
+
+		return 360 - angle;
+	}
+}
+
+LabelPlacer::LabelPlacer(const QFont& font, QPaintDevice* device, int minTextDistance) :
+	m_font(font)
+	, m_metrics(font, device)
+	, m_spacing(std::max(minTextDistance, 1))
+{
+	// a label covers a few cells at most
+	m_cellSize = std::max(16, static_cast<int>(std::ceil(m_metrics.height() * 2)));
+	m_cols = std::max(1, (device->width() + m_cellSize - 1) / m_cellSize);
+	m_rows = std::max(1, (device->height() + m_cellSize - 1) / m_cellSize);
+	m_cells.resize(static_cast<size_t>(m_cols) * m_rows);
+}
+
+const QFont& LabelPlacer::font() const
+{
+	return m_font;
+}
+
+void LabelPlacer::setBounds(const QRectF& bounds)
+{
+	m_bounds = bounds;
+}
+
+PlacedLabels LabelPlacer::place(const Contour& contour)
+{
+	PlacedLabels placed;
+	std::vector<ContourLabel>& labels = placed.labels;
+
+	const std::vector<cv::Point>& points = contour.points;
+	if (points.size() < 2)
+	{
+		return placed;
+	}
+
+	m_arc.resize(points.size());
+	m_arc[0] = 0;
+	for (size_t i = 1; i < points.size(); ++i)
+	{
+		m_arc[i] = m_arc[i - 1] + cv::norm(points[i] - points[i - 1]);
+	}
+
+	double length = m_arc.back();
+	if (length < m_spacing)
+	{
+		splitLine(points, labels, placed.segments);
+		return placed;
+	}
+
+	const QRectF& rect = textRect(contour.depth);
+	QString text = QString::number(contour.depth + 1);
+	double halfWidth = rect.width() / 2;
+	double shift = std::max(halfWidth, 1.0);
+
+	// slots in the middle of every spacing interval, so both ends keep half of the spacing free
+	for (double s = m_spacing / 2; s <= length - m_spacing / 2; s += m_spacing)
+	{
+		for (int attempt = 0; attempt < kPlacementAttempts; ++attempt)
+		{
+			double at = s + attempt * shift;
+			if (at > length - halfWidth)
+			{
+				break;
+			}
+
+			// direction of the chord under the text, a single pixel step only gives multiples of 45 degrees
+			QPointF position = pointAt(points, at);
+			QLineF chord(pointAt(points, std::max(0.0, at - halfWidth)), pointAt(points, std::min(length, at + halfWidth)));
+			double angle = uprightAngle(chord.angle());
+
+			QTransform transform;
+			transform.translate(position.x(), position.y());
+			transform.rotate(angle);
+			QPolygonF area = transform.map(QPolygonF(rect));
+			QRectF bounds = area.boundingRect();
+
+			if ((!m_bounds.isNull() && !m_bounds.contains(bounds)) || collides(area, bounds))
+			{
+				continue;
+			}
+
+			insert(area, bounds);
+			double start = coveredUntil(points, area, at, -1);
+			double end = coveredUntil(points, area, at, 1);
+			labels.push_back({ position, angle, rect, text, area, start, end });
+			break;
+		}
+	}
+
+	splitLine(points, labels, placed.segments);
+	return placed;
+}
+
+const QRectF& LabelPlacer::textRect(int depth)
+{
+	size_t index = static_cast<size_t>(std::max(depth + 1, 0));
+	if (index >= m_textRects.size())
+	{
+		m_textRects.resize(index + 1);
+	}
+
+	QRectF& rect = m_textRects[index];
+	if (rect.isNull())
+	{
+		QString text = QString::number(depth + 1);
+		double width = m_metrics.horizontalAdvance(text);
+		double height = m_metrics.height();
+		rect = QRectF(-width / 2, -height / 2, width, height);
+	}
+	return rect;
+}
+
+QPointF LabelPlacer::pointAt(const std::vector<cv::Point>& points, double s) const
+{
+	size_t i = std::upper_bound(m_arc.begin(), m_arc.end(), s) - m_arc.begin();
+	if (i == 0)
+	{
+		return QPointF(points.front().x, points.front().y);
+	}
+	if (i >= points.size())
+	{
+		return QPointF(points.back().x, points.back().y);
+	}
+
+	double segment = m_arc[i] - m_arc[i - 1];
+	double t = segment > 0 ? (s - m_arc[i - 1]) / segment : 0;
+	return QPointF(points[i - 1].x + t * (points[i].x - points[i - 1].x), points[i - 1].y + t * (points[i].y - points[i - 1].y));
+}
+
+double LabelPlacer::coveredUntil(const std::vector<cv::Point>& points, const QPolygonF& area, double s, int direction) const
+{
+	// walk from the label center to the first point outside of the text rect, the line leaves the rect halfway
+	int last = static_cast<int>(points.size()) - 1;
+	int i = std::min(static_cast<int>(std::upper_bound(m_arc.begin(), m_arc.end(), s) - m_arc.begin()), last);
+	if (direction < 0)
+	{
+		for (int k = i - 1; k >= 0; --k)
+		{
+			if (!area.containsPoint(QPointF(points[k].x, points[k].y), Qt::OddEvenFill))
+			{
+				return std::min(s, (m_arc[k] + m_arc[k + 1]) / 2);
+			}
+		}
+		return 0;
+	}
+
+	for (int k = i; k <= last; ++k)
+	{
+		if (!area.containsPoint(QPointF(points[k].x, points[k].y), Qt::OddEvenFill))
+		{
+			return std::max(s, (m_arc[k - 1] + m_arc[k]) / 2);
+		}
+	}
+	return m_arc.back();
+}
+
+void LabelPlacer::splitLine(const std::vector<cv::Point>& points, const std::vector<ContourLabel>& labels, std::vector<QPolygonF>& segments) const
+{
+	if (labels.empty())
+	{
+		QPolygonF line;
+		for (const cv::Point& pt : points)
+		{
+			line << QPointF(pt.x, pt.y);
+		}
+		segments.push_back(std::move(line));
+		return;
+	}
+
+	// labels are placed in arc order, their intervals only need merging when they touch
+	double from = 0;
+	for (const ContourLabel& label : labels)
+	{
+		appendSegment(points, from, label.start, segments);
+		from = std::max(from, label.end);
+	}
+	appendSegment(points, from, m_arc.back(), segments);
+}
+
+void LabelPlacer::appendSegment(const std::vector<cv::Point>& points, double from, double to, std::vector<QPolygonF>& segments) const
+{
+	if (to <= from)
+	{
+		return;
+	}
+
+	QPolygonF segment;
+	segment << pointAt(points, from);
+	size_t first = std::upper_bound(m_arc.begin(), m_arc.end(), from) - m_arc.begin();
+	for (size_t i = first; i < points.size() && m_arc[i] < to; ++i)
+	{
+		segment << QPointF(points[i].x, points[i].y);
+	}
+	segment << pointAt(points, to);
+	segments.push_back(std::move(segment));
+}
+
+QRect LabelPlacer::cellRange(const QRectF& bounds) const
+{
+	int left = std::clamp(static_cast<int>(std::floor(bounds.left() / m_cellSize)), 0, m_cols - 1);
+	int top = std::clamp(static_cast<int>(std::floor(bounds.top() / m_cellSize)), 0, m_rows - 1);
+	int right = std::clamp(static_cast<int>(std::floor(bounds.right() / m_cellSize)), 0, m_cols - 1);
+	int bottom = std::clamp(static_cast<int>(std::floor(bounds.bottom() / m_cellSize)), 0, m_rows - 1);
+	return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+bool LabelPlacer::collides(const QPolygonF& area, const QRectF& bounds) const
+{
+	QRect range = cellRange(bounds);
+	for (int row = range.top(); row <= range.bottom(); ++row)
+	{
+		for (int col = range.left(); col <= range.right(); ++col)
+		{
+			for (int index : m_cells[static_cast<size_t>(row) * m_cols + col])
+			{
+				// bounding rects first, the exact test only for the few close labels
+				if (m_placedBounds[index].intersects(bounds) && m_placed[index].intersects(area))
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void LabelPlacer::insert(const QPolygonF& area, const QRectF& bounds)
+{
+	int index = static_cast<int>(m_placed.size());
+	m_placed.push_back(area);
+	m_placedBounds.push_back(bounds);
+
+	QRect range = cellRange(bounds);
+	for (int row = range.top(); row <= range.bottom(); ++row)
+	{
+		for (int col = range.left(); col <= range.right(); ++col)
+		{
+			m_cells[static_cast<size_t>(row) * m_cols + col].push_back(index);
+		}
+	}
+}
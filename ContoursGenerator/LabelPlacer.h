@@ -0,0 +1,68 @@
+#pragma once
+#include <QFont>
+#include <QFontMetricsF>
+#include <QPolygonF>
+#include <QString>
+#include <vector>
+#include <opencv2/core.hpp>
+
+struct Contour;
+class QPaintDevice;
+
+// Value label of a contour, the text is drawn centered at position and rotated by angle degrees
+struct ContourLabel
+{
+    QPointF position;
+    double angle;
+    QRectF textRect; // text rect around (0, 0) before rotation
+    QString text;
+    QPolygonF area; // rotated text rect in image coordinates
+    double start, end; // arc length interval of the contour covered by the text
+};
+
+// Labels of one contour and the parts of the contour line left visible between them
+struct PlacedLabels
+{
+    std::vector<ContourLabel> labels;
+    std::vector<QPolygonF> segments;
+};
+
+// Places value labels along the contours of one image.
+// Positions are picked on the cumulative arc length, every minTextDistance pixels of the contour,
+// and the line is split at the arc intervals under the labels, so no clipping is needed to draw it.
+// Labels of all contours are kept in a uniform grid and a label never overlaps an already placed one,
+// text metrics are measured once per depth.
+class LabelPlacer
+{
+public:
+    LabelPlacer(const QFont& font, QPaintDevice* device, int minTextDistance);
+
+    PlacedLabels place(const Contour& contour);
+    const QFont& font() const;
+    // Labels must lie completely inside bounds, e.g. the owned part of a tile drawn with a margin. Not checked by default
+    void setBounds(const QRectF& bounds);
+
+private:
+    const QRectF& textRect(int depth);
+    QPointF pointAt(const std::vector<cv::Point>& points, double s) const;
+    double coveredUntil(const std::vector<cv::Point>& points, const QPolygonF& area, double s, int direction) const;
+    void splitLine(const std::vector<cv::Point>& points, const std::vector<ContourLabel>& labels, std::vector<QPolygonF>& segments) const;
+    void appendSegment(const std::vector<cv::Point>& points, double from, double to, std::vector<QPolygonF>& segments) const;
+    bool collides(const QPolygonF& area, const QRectF& bounds) const;
+    void insert(const QPolygonF& area, const QRectF& bounds);
+    QRect cellRange(const QRectF& bounds) const;
+
+    QFont m_font;
+    QFontMetricsF m_metrics;
+    double m_spacing;
+
+    int m_cellSize;
+    int m_cols, m_rows;
+    std::vector<std::vector<int>> m_cells; // indices of the placed labels overlapping each cell
+    std::vector<QPolygonF> m_placed;
+    std::vector<QRectF> m_placedBounds;
+    QRectF m_bounds;
+
+    std::vector<QRectF> m_textRects; // by depth + 1, null until measured
+    std::vector<double> m_arc; // cumulative arc length of the current contour
+};
@@ -26,7 +26,9 @@
 //----------------------------------------------------------------------------------------
 
 # pragma once
+# include <cstddef>
 # include <cstdint>
+# include <cmath>
 # include <algorithm>
 # include <array>
 # include <iterator>
@@ -39,6 +41,16 @@
 # endif
 
 
+// SIMD width used by the row evaluation (define SIVPERLIN_NO_SIMD to force the scalar path)
+# if !defined(SIVPERLIN_NO_SIMD) && defined(__AVX__)
+#	define SIVPERLIN_SIMD_AVX
+#	include <immintrin.h>
+# elif !defined(SIVPERLIN_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#	define SIVPERLIN_SIMD_SSE2
+#	include <emmintrin.h>
+# endif
+
+
 // Library major version
 # define SIVPERLIN_VERSION_MAJOR			3
 
@@ -236,8 +248,59 @@ namespace siv
 		[[nodiscard]]
 		value_type normalizedOctave3D_01(value_type x, value_type y, value_type z, std::int32_t octaves, value_type persistence = value_type(0.5)) const noexcept;
 
+		///////////////////////////////////////
+		//
+		//	Row noise (out[i] = noise2D(x0 + i * dx, y), the result is in the range [-1, 1])
+		//
+		//	Lattice hashes and gradients are computed once per cell run and the positions
+		//	of a run are evaluated with SIMD. The arithmetic is the same as noise2D(),
+		//	the results are identical as long as the compiler does not contract
+		//	multiply-add into FMA (MSVC default /fp:precise, GCC/Clang -ffp-contract=off).
+		//
+
+		void noise2DRow(value_type x0, value_type dx, value_type y, std::size_t count, value_type* out) const noexcept;
+
+		void noise2DRow_01(value_type x0, value_type dx, value_type y, std::size_t count, value_type* out) const noexcept;
+
+		// Part of a longer row: out[i] = noise2D(x0 + (first + i) * dx, y). The positions are computed from the index
+		// in the whole row, so neighbouring parts of a row give the same values as one noise2DRow() call.
+		void noise2DRow(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, value_type* out) const noexcept;
+
+		void noise2DRow_01(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, value_type* out) const noexcept;
+
+		// Row r of the block is written to out + r * stride with y = y0 + r * dy
+		void noise2DBlock(value_type x0, value_type dx, value_type y0, value_type dy, std::size_t cols, std::size_t rows, value_type* out, std::size_t stride) const noexcept;
+
+		void noise2DBlock_01(value_type x0, value_type dx, value_type y0, value_type dy, std::size_t cols, std::size_t rows, value_type* out, std::size_t stride) const noexcept;
+
+		///////////////////////////////////////
+		//
+		//	Octave row noise (out[i] = octave2D(x0 + (first + i) * dx, y, octaves, persistence))
+		//
+		//	Octaves are row evaluations at doubled frequency accumulated in place, so the lattice
+		//	hashes and gradients are computed once per cell run of every octave instead of once
+		//	per position and octave. Positions of octave k are the ones of octave 0 scaled by 2^k,
+		//	which is exact, so the sums are identical to octave2D() under the same conditions as noise2DRow().
+		//
+
+		void octave2DRow(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, std::int32_t octaves, value_type persistence, value_type* out) const noexcept;
+
+		// Same values as normalizedOctave2D_01()
+		void normalizedOctave2DRow_01(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, std::int32_t octaves, value_type persistence, value_type* out) const noexcept;
+
+		// Ridged octave noise: sum of (1 - |noise2D|)^2 * amplitude over the octaves, divided by the sum of the amplitudes,
+		// so the result is in the range [0, 1] with crests along the zero crossings of every octave
+		void ridgedOctave2DRow_01(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, std::int32_t octaves, value_type persistence, value_type* out) const noexcept;
+
 	private:
 
+		// Row evaluation shared by the row functions, Op combines every value with out
+		template <class Op>
+		void evaluateRow(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, value_type amplitude, value_type* out) const noexcept;
+
+		template <class Op>
+		void octaveRow(value_type x0, value_type dx, value_type y, std::size_t first, std::size_t count, std::int32_t octaves, value_type persistence, value_type* out) const noexcept;
+
 		state_type m_permutation;
 	};
 
@@ -387,6 +450,253 @@ namespace siv
 			return result;
 		}
 
+		////////////////////////////////////////////////
+		//
+		//	Row evaluation
+		//
+
+		// Grad() of a lattice corner with fixed y and z terms, written as c + s * x
+		template <class Float>
+		inline constexpr void GradCoefficients(const std::uint8_t hash, const Float y, const Float z, Float& c, Float& s) noexcept
+		{
+			const std::uint8_t h = hash & 15;
+			if (h < 8)
+			{
+				s = (h & 1) == 0 ? Float(1) : Float(-1);
+				const Float v = h < 4 ? y : z;
+				c = (h & 2) == 0 ? v : -v;
+			}
+			else
+			{
+				const Float u = (h & 1) == 0 ? y : -y;
+				if (h == 12 || h == 14)
+				{
+					s = (h & 2) == 0 ? Float(1) : Float(-1);
+					c = u;
+				}
+				else
+				{
+					s = Float(0);
+					c = u + ((h & 2) == 0 ? z : -z);
+				}
+			}
+		}
+
+		// GradCoefficients() of the 16 gradients for the four y/z offsets of the cell corners,
+		// y and z are fixed along a row, so a cell only looks its corners up
+		template <class Float>
+		struct GradTable
+		{
+			Float c[4][16];
+			Float s[4][16];
+
+			GradTable(const Float fy, const Float fz) noexcept
+			{
+				for (int corner = 0; corner < 4; ++corner)
+				{
+					const Float y = (corner & 1) == 0 ? fy : fy - 1;
+					const Float z = (corner & 2) == 0 ? fz : fz - 1;
+					for (int h = 0; h < 16; ++h)
+					{
+						GradCoefficients(static_cast<std::uint8_t>(h), y, z, c[corner][h], s[corner][h]);
+					}
+				}
+			}
+		};
+
+		// Constants of one lattice cell along a row: corner gradients and the y/z fade weights
+		template <class Float>
+		struct RowCell
+		{
+			Float cellX;
+			Float c[8];
+			Float s[8];
+			Float v;
+			Float w;
+		};
+
+		// Scalar lane, also used for the tail of SIMD runs
+		template <class Float>
+		struct ScalarLanes
+		{
+			using type = Float;
+			static constexpr std::size_t width = 1;
+			static type set1(const Float a) noexcept { return a; }
+			static type iota(const Float start) noexcept { return start; }
+			static type add(const type a, const type b) noexcept { return a + b; }
+			static type sub(const type a, const type b) noexcept { return a - b; }
+			static type mul(const type a, const type b) noexcept { return a * b; }
+			static type max(const type a, const type b) noexcept { return a < b ? b : a; }
+			static type load(const Float* p) noexcept { return *p; }
+			static void store(Float* p, const type a) noexcept { *p = a; }
+		};
+
+		template <class Float>
+		struct SimdLanes : ScalarLanes<Float> {};
+
+# if defined(SIVPERLIN_SIMD_AVX)
+
+		template <>
+		struct SimdLanes<double>
+		{
+			using type = __m256d;
+			static constexpr std::size_t width = 4;
+			static type set1(const double a) noexcept { return _mm256_set1_pd(a); }
+			static type iota(const double start) noexcept { return _mm256_set_pd(start + 3, start + 2, start + 1, start); }
+			static type add(const type a, const type b) noexcept { return _mm256_add_pd(a, b); }
+			static type sub(const type a, const type b) noexcept { return _mm256_sub_pd(a, b); }
+			static type mul(const type a, const type b) noexcept { return _mm256_mul_pd(a, b); }
+			static type max(const type a, const type b) noexcept { return _mm256_max_pd(a, b); }
+			static type load(const double* p) noexcept { return _mm256_loadu_pd(p); }
+			static void store(double* p, const type a) noexcept { _mm256_storeu_pd(p, a); }
+		};
+
+		template <>
+		struct SimdLanes<float>
+		{
+			using type = __m256;
+			static constexpr std::size_t width = 8;
+			static type set1(const float a) noexcept { return _mm256_set1_ps(a); }
+			static type iota(const float start) noexcept { return _mm256_set_ps(start + 7, start + 6, start + 5, start + 4, start + 3, start + 2, start + 1, start); }
+			static type add(const type a, const type b) noexcept { return _mm256_add_ps(a, b); }
+			static type sub(const type a, const type b) noexcept { return _mm256_sub_ps(a, b); }
+			static type mul(const type a, const type b) noexcept { return _mm256_mul_ps(a, b); }
+			static type max(const type a, const type b) noexcept { return _mm256_max_ps(a, b); }
+			static type load(const float* p) noexcept { return _mm256_loadu_ps(p); }
+			static void store(float* p, const type a) noexcept { _mm256_storeu_ps(p, a); }
+		};
+
+# elif defined(SIVPERLIN_SIMD_SSE2)
+
+		template <>
+		struct SimdLanes<double>
+		{
+			using type = __m128d;
+			static constexpr std::size_t width = 2;
+			static type set1(const double a) noexcept { return _mm_set1_pd(a); }
+			static type iota(const double start) noexcept { return _mm_set_pd(start + 1, start); }
+			static type add(const type a, const type b) noexcept { return _mm_add_pd(a, b); }
+			static type sub(const type a, const type b) noexcept { return _mm_sub_pd(a, b); }
+			static type mul(const type a, const type b) noexcept { return _mm_mul_pd(a, b); }
+			static type max(const type a, const type b) noexcept { return _mm_max_pd(a, b); }
+			static type load(const double* p) noexcept { return _mm_loadu_pd(p); }
+			static void store(double* p, const type a) noexcept { _mm_storeu_pd(p, a); }
+		};
+
+		template <>
+		struct SimdLanes<float>
+		{
+			using type = __m128;
+			static constexpr std::size_t width = 4;
+			static type set1(const float a) noexcept { return _mm_set1_ps(a); }
+			static type iota(const float start) noexcept { return _mm_set_ps(start + 3, start + 2, start + 1, start); }
+			static type add(const type a, const type b) noexcept { return _mm_add_ps(a, b); }
+			static type sub(const type a, const type b) noexcept { return _mm_sub_ps(a, b); }
+			static type mul(const type a, const type b) noexcept { return _mm_mul_ps(a, b); }
+			static type max(const type a, const type b) noexcept { return _mm_max_ps(a, b); }
+			static type load(const float* p) noexcept { return _mm_loadu_ps(p); }
+			static void store(float* p, const type a) noexcept { _mm_storeu_ps(p, a); }
+		};
+
+# endif
+
+		// What a row evaluation does with the noise value n of a position
+		struct RowStore
+		{
+			// out = n
+			template <class L, class Float>
+			static void apply(Float* out, const typename L::type n, const typename L::type) noexcept
+			{
+				L::store(out, n);
+			}
+		};
+
+		struct RowAccumulate
+		{
+			// out += n * amplitude, the sum of Octave2D()
+			template <class L, class Float>
+			static void apply(Float* out, const typename L::type n, const typename L::type amplitude) noexcept
+			{
+				L::store(out, L::add(L::load(out), L::mul(n, amplitude)));
+			}
+		};
+
+		struct RowAccumulateRidged
+		{
+			// out += (1 - |n|)^2 * amplitude, sharp crests where the noise crosses zero
+			template <class L, class Float>
+			static void apply(Float* out, const typename L::type n, const typename L::type amplitude) noexcept
+			{
+				const typename L::type ridge = L::sub(L::set1(Float(1)), L::max(n, L::sub(L::set1(Float(0)), n)));
+				L::store(out, L::add(L::load(out), L::mul(L::mul(ridge, ridge), amplitude)));
+			}
+		};
+
+		// Evaluates indices [begin, end) of a row that all lie in the same cell, out points to index first.
+		// Mirrors noise3D() operation by operation, Op combines the value with out.
+		template <class Lanes, class Op, class Float>
+		inline std::size_t EvaluateRun(const RowCell<Float>& cell, const Float x0, const Float dx, std::size_t begin, const std::size_t end, const std::size_t first,
+			const Float amplitude, Float* out) noexcept
+		{
+			using L = Lanes;
+			using V = typename L::type;
+
+			const V vx0 = L::set1(x0);
+			const V vdx = L::set1(dx);
+			const V vcell = L::set1(cell.cellX);
+			const V one = L::set1(Float(1));
+			const V k6 = L::set1(Float(6));
+			const V k15 = L::set1(Float(15));
+			const V k10 = L::set1(Float(10));
+			const V v = L::set1(cell.v);
+			const V w = L::set1(cell.w);
+			const V amp = L::set1(amplitude);
+
+			V c[8], s[8];
+			for (int k = 0; k < 8; ++k)
+			{
+				c[k] = L::set1(cell.c[k]);
+				s[k] = L::set1(cell.s[k]);
+			}
+
+			V index = L::iota(static_cast<Float>(begin));
+			const V step = L::set1(static_cast<Float>(L::width));
+
+			for (; begin + L::width <= end; begin += L::width)
+			{
+				const V x = L::add(vx0, L::mul(index, vdx));
+				const V fx = L::sub(x, vcell);
+				const V fx1 = L::sub(fx, one);
+
+				// Fade(): t * t * t * (t * (t * 6 - 15) + 10)
+				const V u = L::mul(L::mul(L::mul(fx, fx), fx), L::add(L::mul(fx, L::sub(L::mul(fx, k6), k15)), k10));
+
+				const V p0 = L::add(c[0], L::mul(s[0], fx));
+				const V p1 = L::add(c[1], L::mul(s[1], fx1));
+				const V p2 = L::add(c[2], L::mul(s[2], fx));
+				const V p3 = L::add(c[3], L::mul(s[3], fx1));
+				const V p4 = L::add(c[4], L::mul(s[4], fx));
+				const V p5 = L::add(c[5], L::mul(s[5], fx1));
+				const V p6 = L::add(c[6], L::mul(s[6], fx));
+				const V p7 = L::add(c[7], L::mul(s[7], fx1));
+
+				// Lerp(): a + (b - a) * t
+				const V q0 = L::add(p0, L::mul(L::sub(p1, p0), u));
+				const V q1 = L::add(p2, L::mul(L::sub(p3, p2), u));
+				const V q2 = L::add(p4, L::mul(L::sub(p5, p4), u));
+				const V q3 = L::add(p6, L::mul(L::sub(p7, p6), u));
+
+				const V r0 = L::add(q0, L::mul(L::sub(q1, q0), v));
+				const V r1 = L::add(q2, L::mul(L::sub(q3, q2), v));
+
+				Op::template apply<L>(out + (begin - first), L::add(r0, L::mul(L::sub(r1, r0), w)), amp);
+
+				index = L::add(index, step);
+			}
+
+			return begin;
+		}
+
 		template <class Float>
 		[[nodiscard]]
 		inline constexpr Float MaxAmplitude(const std::int32_t octaves, const Float persistence) noexcept
@@ -652,6 +962,189 @@ namespace siv
 	{
 		return perlin_detail::Remap_01(normalizedOctave3D(x, y, z, octaves, persistence));
 	}
+
+	///////////////////////////////////////
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DRow(const value_type x0, const value_type dx, const value_type y, const std::size_t count, value_type* out) const noexcept
+	{
+		noise2DRow(x0, dx, y, 0, count, out);
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DRow(const value_type x0, const value_type dx, const value_type y, const std::size_t first, const std::size_t count, value_type* out) const noexcept
+	{
+		evaluateRow<perlin_detail::RowStore>(x0, dx, y, first, count, value_type(1), out);
+	}
+
+	template <class Float>
+	template <class Op>
+	inline void BasicPerlinNoise<Float>::evaluateRow(const value_type x0, const value_type dx, const value_type y, const std::size_t first, const std::size_t count,
+		const value_type amplitude, value_type* out) const noexcept
+	{
+		const value_type z = static_cast<value_type>(SIVPERLIN_DEFAULT_Z);
+
+		const value_type _y = std::floor(y);
+		const value_type _z = std::floor(z);
+
+		const std::int32_t iy = static_cast<std::int32_t>(_y) & 255;
+		const std::int32_t iz = static_cast<std::int32_t>(_z) & 255;
+
+		const value_type fy = (y - _y);
+		const value_type fz = (z - _z);
+
+		perlin_detail::RowCell<value_type> cell;
+		cell.v = perlin_detail::Fade(fy);
+		cell.w = perlin_detail::Fade(fz);
+		const perlin_detail::GradTable<value_type> grads(fy, fz);
+
+		const auto position = [x0, dx](const std::size_t i) { return x0 + static_cast<value_type>(i) * dx; };
+		const value_type invDx = dx > 0 ? 1 / dx : 0;
+
+		const std::size_t last = first + count;
+		std::size_t i = first;
+		while (i < last)
+		{
+			const value_type _x = std::floor(position(i));
+
+			// end of the run of positions in the same cell
+			std::size_t end = i + 1;
+			if (dx > 0)
+			{
+				// the estimate may be off by rounding, the loops below correct it
+				const value_type estimate = std::ceil((_x + 1 - x0) * invDx);
+				end = estimate < static_cast<value_type>(last) ? std::max(end, static_cast<std::size_t>(estimate)) : last;
+				while (end > i + 1 && std::floor(position(end - 1)) != _x)
+				{
+					--end;
+				}
+			}
+			while (end < last && std::floor(position(end)) == _x)
+			{
+				++end;
+			}
+
+			const std::int32_t ix = static_cast<std::int32_t>(_x) & 255;
+
+			const std::uint8_t A = (m_permutation[ix & 255] + iy) & 255;
+			const std::uint8_t B = (m_permutation[(ix + 1) & 255] + iy) & 255;
+
+			const std::uint8_t AA = (m_permutation[A] + iz) & 255;
+			const std::uint8_t AB = (m_permutation[(A + 1) & 255] + iz) & 255;
+
+			const std::uint8_t BA = (m_permutation[B] + iz) & 255;
+			const std::uint8_t BB = (m_permutation[(B + 1) & 255] + iz) & 255;
+
+			// corners in the order of noise3D(): k = 2 * (y/z offset) + (x offset)
+			const std::uint8_t hashes[8] = { AA, BA, AB, BB, static_cast<std::uint8_t>((AA + 1) & 255), static_cast<std::uint8_t>((BA + 1) & 255),
+				static_cast<std::uint8_t>((AB + 1) & 255), static_cast<std::uint8_t>((BB + 1) & 255) };
+			cell.cellX = _x;
+			for (int k = 0; k < 8; ++k)
+			{
+				const std::uint8_t h = m_permutation[hashes[k]] & 15;
+				cell.c[k] = grads.c[k >> 1][h];
+				cell.s[k] = grads.s[k >> 1][h];
+			}
+
+			// short runs of high frequencies skip the SIMD setup
+			if (end - i >= perlin_detail::SimdLanes<value_type>::width)
+			{
+				i = perlin_detail::EvaluateRun<perlin_detail::SimdLanes<value_type>, Op>(cell, x0, dx, i, end, first, amplitude, out);
+			}
+			i = perlin_detail::EvaluateRun<perlin_detail::ScalarLanes<value_type>, Op>(cell, x0, dx, i, end, first, amplitude, out);
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DRow_01(const value_type x0, const value_type dx, const value_type y, const std::size_t count, value_type* out) const noexcept
+	{
+		noise2DRow(x0, dx, y, count, out);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = perlin_detail::Remap_01(out[i]);
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DRow_01(const value_type x0, const value_type dx, const value_type y, const std::size_t first, const std::size_t count, value_type* out) const noexcept
+	{
+		noise2DRow(x0, dx, y, first, count, out);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = perlin_detail::Remap_01(out[i]);
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DBlock(const value_type x0, const value_type dx, const value_type y0, const value_type dy, const std::size_t cols, const std::size_t rows, value_type* out, const std::size_t stride) const noexcept
+	{
+		for (std::size_t r = 0; r < rows; ++r)
+		{
+			noise2DRow(x0, dx, y0 + static_cast<value_type>(r) * dy, cols, out + r * stride);
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::noise2DBlock_01(const value_type x0, const value_type dx, const value_type y0, const value_type dy, const std::size_t cols, const std::size_t rows, value_type* out, const std::size_t stride) const noexcept
+	{
+		for (std::size_t r = 0; r < rows; ++r)
+		{
+			noise2DRow_01(x0, dx, y0 + static_cast<value_type>(r) * dy, cols, out + r * stride);
+		}
+	}
+
+	template <class Float>
+	template <class Op>
+	inline void BasicPerlinNoise<Float>::octaveRow(value_type x0, value_type dx, value_type y, const std::size_t first, const std::size_t count,
+		const std::int32_t octaves, const value_type persistence, value_type* out) const noexcept
+	{
+		std::fill(out, out + count, value_type(0));
+
+		value_type amplitude = 1;
+		for (std::int32_t k = 0; k < octaves; ++k)
+		{
+			evaluateRow<Op>(x0, dx, y, first, count, amplitude, out);
+			x0 *= 2;
+			dx *= 2;
+			y *= 2;
+			amplitude *= persistence;
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::octave2DRow(const value_type x0, const value_type dx, const value_type y, const std::size_t first, const std::size_t count,
+		const std::int32_t octaves, const value_type persistence, value_type* out) const noexcept
+	{
+		octaveRow<perlin_detail::RowAccumulate>(x0, dx, y, first, count, octaves, persistence, out);
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::normalizedOctave2DRow_01(const value_type x0, const value_type dx, const value_type y, const std::size_t first, const std::size_t count,
+		const std::int32_t octaves, const value_type persistence, value_type* out) const noexcept
+	{
+		octaveRow<perlin_detail::RowAccumulate>(x0, dx, y, first, count, octaves, persistence, out);
+
+		const value_type maxAmplitude = perlin_detail::MaxAmplitude(octaves, persistence);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = perlin_detail::Remap_01(out[i] / maxAmplitude);
+		}
+	}
+
+	template <class Float>
+	inline void BasicPerlinNoise<Float>::ridgedOctave2DRow_01(const value_type x0, const value_type dx, const value_type y, const std::size_t first, const std::size_t count,
+		const std::int32_t octaves, const value_type persistence, value_type* out) const noexcept
+	{
+		octaveRow<perlin_detail::RowAccumulateRidged>(x0, dx, y, first, count, octaves, persistence, out);
+
+		const value_type maxAmplitude = perlin_detail::MaxAmplitude(octaves, persistence);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			out[i] = out[i] / maxAmplitude;
+		}
+	}
 }
 
 # undef SIVPERLIN_NODISCARD_CXX20
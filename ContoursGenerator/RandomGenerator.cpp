@@ -1,9 +1,31 @@
 #include "RandomGenerator.h"
 
-RandomGenerator& RandomGenerator::instance()
+namespace
 {
-	static RandomGenerator generator;
-	return generator;
+	// splitmix64 finalizer, decorrelates consecutive counters
+	uint64_t mixSeed(uint64_t x)
+	{
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+}
+
+RandomGenerator::RandomGenerator(uint64_t seed) :
+	m_seed(seed), rng(mixSeed(seed))
+{
+}
+
+RandomGenerator RandomGenerator::forSample(uint64_t baseSeed, uint64_t index)
+{
+	return RandomGenerator(mixSeed(baseSeed) ^ index);
+}
+
+uint64_t RandomGenerator::randomSeed()
+{
+	std::random_device dev;
+	return (static_cast<uint64_t>(dev()) << 32) | dev();
 }
 
 QPoint RandomGenerator::getRandomPoint(int maxWidth, int maxHeight)
@@ -18,11 +40,16 @@ QColor RandomGenerator::getRandomColor()
 
 int RandomGenerator::getRandomInt(int max)
 {
-	return distribution(rng) * max;
+	return getRandomDouble() * max;
 }
 
+uint64_t RandomGenerator::seed() const
+{
+	return m_seed;
+}
 
-RandomGenerator::RandomGenerator() :
-	rng(dev()), distribution(0.0, 1.0)
+double RandomGenerator::getRandomDouble()
 {
+	// std::uniform_real_distribution differs between standard libraries, keep samples portable
+	return (rng() >> 11) * (1.0 / 9007199254740992.0);
 }
@@ -1,24 +1,31 @@
 #pragma once
 #include <qpoint.h>
 #include <random>
-#include <map>
+#include <cstdint>
 #include <qcolor.h>
 
+// Random stream of one generated sample. Streams are plain values owned by the pipeline,
+// so parallel workers never share state and a sample is reproducible from its seed.
 class RandomGenerator
 {
 public:
-	static RandomGenerator& instance();
+	explicit RandomGenerator(uint64_t seed);
+
+	// Stream of sample `index` in a run started with `baseSeed`. Seeds are derived with a counter-based mix,
+	// so any sample can be regenerated without replaying the previous ones.
+	static RandomGenerator forSample(uint64_t baseSeed, uint64_t index);
+	// Non-deterministic seed for runs where no seed was requested
+	static uint64_t randomSeed();
+
 	QPoint getRandomPoint(int maxWidth, int maxHeight);
 	QColor getRandomColor();
 	int getRandomInt(int max);
 
-	RandomGenerator(const RandomGenerator&) = delete;
-	void operator=(const RandomGenerator&) = delete;
+	uint64_t seed() const;
+
 private:
-	RandomGenerator();
+	double getRandomDouble(); // uniform in [0, 1)
 
-	std::random_device dev;
-	std::mt19937 rng;
-	std::uniform_real_distribution<> distribution;
+	uint64_t m_seed;
+	std::mt19937_64 rng;
 };
-
@@ -0,0 +1,90 @@
+#include "SampleStats.h"
+#include <QStringList>
+#include <algorithm>
+#include <numeric>
+
+const char* stageName(Stage stage)
+{
+	static const char* names[] = { "noise", "sobel", "thinning", "tracing", "depth", "fill", "inpaint", "labels", "wells", "encode" };
+	static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Stage::COUNT), "a name for every stage");
+	return names[static_cast<int>(stage)];
+}
+
+double SampleStats::totalMs() const
+{
+	return std::accumulate(std::begin(ms), std::end(ms), 0.0);
+}
+
+void SampleStats::add(const SampleStats& other)
+{
+	for (int i = 0; i < static_cast<int>(Stage::COUNT); ++i)
+	{
+		ms[i] += other.ms[i];
+	}
+	contours += other.contours;
+	points += other.points;
+	labels += other.labels;
+	bytes += other.bytes;
+}
+
+QString SampleStats::summary() const
+{
+	// three slowest stages are enough to see where the time goes
+	int order[static_cast<int>(Stage::COUNT)];
+	std::iota(std::begin(order), std::end(order), 0);
+	std::sort(std::begin(order), std::end(order), [this](int a, int b) { return ms[a] > ms[b]; });
+
+	QStringList stages;
+	for (int i = 0; i < 3 && ms[order[i]] > 0; ++i)
+	{
+		stages << QString("%1 %2").arg(stageName(static_cast<Stage>(order[i]))).arg(ms[order[i]], 0, 'f', 1);
+	}
+
+	QString text = QString("%1 ms (%2), %3 contours, %4 points, %5 labels")
+		.arg(totalMs(), 0, 'f', 1).arg(stages.join(", ")).arg(contours).arg(points).arg(labels);
+	if (bytes > 0)
+	{
+		text += QString(", %1 KiB").arg(bytes / 1024);
+	}
+	return text;
+}
+
+QString SampleStats::csvHeader()
+{
+	QStringList columns;
+	for (int i = 0; i < static_cast<int>(Stage::COUNT); ++i)
+	{
+		columns << QString("%1_ms").arg(stageName(static_cast<Stage>(i)));
+	}
+	columns << "total_ms" << "contours" << "points" << "labels" << "bytes";
+	return columns.join(',');
+}
+
+QString SampleStats::csvRow() const
+{
+	QStringList values;
+	for (int i = 0; i < static_cast<int>(Stage::COUNT); ++i)
+	{
+		values << QString::number(ms[i], 'f', 3);
+	}
+	values << QString::number(totalMs(), 'f', 3) << QString::number(contours) << QString::number(points) << QString::number(labels) << QString::number(bytes);
+	return values.join(',');
+}
+
+StageTimer::StageTimer(SampleStats* stats, Stage stage) :
+	m_stats(stats)
+	, m_stage(stage)
+{
+	if (m_stats)
+	{
+		m_start = std::chrono::steady_clock::now();
+	}
+}
+
+StageTimer::~StageTimer()
+{
+	if (m_stats)
+	{
+		m_stats->ms[static_cast<int>(m_stage)] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <QString>
+#include <chrono>
+#include <cstdint>
+
+// Pipeline stages timed per sample
+enum class Stage
+{
+    NOISE,
+    SOBEL,
+    THINNING,
+    TRACING,
+    DEPTH,
+    FILL,
+    INPAINT,
+    LABELS,
+    WELLS,
+    ENCODE,
+    COUNT
+};
+
+const char* stageName(Stage stage);
+
+// Stage times and counters of one generated sample, or sums over samples
+struct SampleStats
+{
+    double ms[static_cast<int>(Stage::COUNT)] = {};
+    int64_t contours = 0;
+    int64_t points = 0; // contour pixels
+    int64_t labels = 0; // value labels placed
+    int64_t bytes = 0; // encoded bytes written, images and masks
+
+    double totalMs() const;
+    void add(const SampleStats& other);
+    // Short text for a status bar: total time, the slowest stages and the counters
+    QString summary() const;
+
+    // CSV columns of csvRow()
+    static QString csvHeader();
+    QString csvRow() const;
+};
+
+// Adds the time of its scope to one stage. With null stats nothing is measured, the clock is not even read,
+// so instrumented code costs one branch per stage when statistics are off.
+class StageTimer
+{
+public:
+    StageTimer(SampleStats* stats, Stage stage);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    SampleStats* m_stats;
+    Stage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
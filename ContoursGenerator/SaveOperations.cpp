@@ -0,0 +1,15 @@
+#include "SaveOperations.h"
+#include "DatasetWriter.h"
+#include "ImageGenerator.h"
+
+void SaveOperations::saveImageSplit(const QString& folderPath, const GenImg& gen, const OutputFormat& format)
+{
+	DatasetWriter writer(folderPath, format);
+	writer.writeSplit(writer.reserve(DatasetWriter::splitCount(gen.image.size())), gen);
+}
+
+void SaveOperations::saveImage(const QString& folderPath, const cv::Mat& img, const cv::Mat& mask, const OutputFormat& format)
+{
+	DatasetWriter writer(folderPath, format, 1);
+	writer.write(img, mask);
+}
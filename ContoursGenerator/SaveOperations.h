@@ -0,0 +1,15 @@
+#pragma once
+#include <QString>
+#include "EncodeOperations.h"
+
+struct GenImg;
+namespace cv { class Mat; }
+
+// One-shot saves through a DatasetWriter, keep a DatasetWriter for the whole session when saving many samples
+namespace SaveOperations
+{
+    // Split generated image into 256x256 tiles and save each of them
+    void saveImageSplit(const QString& folderPath, const GenImg& gen, const OutputFormat& format = OutputFormat());
+    // Save image and mask after the highest index in <folder>/images and <folder>/masks
+    void saveImage(const QString& folderPath, const cv::Mat& img, const cv::Mat& mask, const OutputFormat& format = OutputFormat());
+};
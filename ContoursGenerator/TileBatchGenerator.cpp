@@ -0,0 +1,330 @@
+#include "TileBatchGenerator.h"
+#include "DatasetWriter.h"
+#include "ImageGenerator.h"
+#include "RandomGenerator.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+	// one canvas is tiled while the field of the next one is generated
+	const size_t kCanvasesInFlight = 2;
+
+	// tile starts along one side, the last tile is aligned to the border if the grid does not reach it
+	std::vector<int> gridStarts(int length, int size, int stride)
+	{
+		std::vector<int> starts;
+		for (int p = 0; p + size <= length; p += stride)
+		{
+			starts.push_back(p);
+		}
+		if (!starts.empty() && starts.back() + size < length)
+		{
+			starts.push_back(length - size);
+		}
+		return starts;
+	}
+}
+
+TileBatchGenerator::TileBatchGenerator(const GenerationParams& params, const WellParams& wellParams, const QString& folderPath, uint64_t baseSeed,
+	const TileSampling& sampling, const OutputFormat& format) :
+	m_params(params)
+	, m_wellParams(wellParams)
+	, m_folderPath(folderPath)
+	, m_format(format)
+	, m_sampling(sampling)
+	, m_baseSeed(baseSeed)
+{
+}
+
+void TileBatchGenerator::run(int count, int numWorkers)
+{
+	if (numWorkers <= 0)
+	{
+		numWorkers = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	m_completed = 0;
+	m_written = 0;
+	m_skipped = 0;
+	m_failed = 0;
+	m_stats.assign(m_collectStats ? std::max(0, count) * tileCount() : 0, SampleStats());
+	m_canvases.clear();
+	m_nextCanvas = 0;
+	m_creating = 0;
+
+	// two tiles per worker in the queue are enough to hide the saving latency
+	DatasetWriter writer(m_folderPath, m_format, 0, 2 * numWorkers);
+	// tiles finish out of order, their files must not
+	m_firstIndex = writer.reserve(std::max(0, count) * tileCount());
+
+	std::vector<std::thread> workers;
+	workers.reserve(numWorkers);
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		workers.emplace_back(&TileBatchGenerator::workerLoop, this, std::ref(writer), count);
+	}
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	writer.finish();
+	m_failed = writer.failed();
+	m_canvases.clear();
+
+	if (m_collectStats)
+	{
+		writeStats();
+	}
+}
+
+void TileBatchGenerator::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_canceled = true;
+	}
+	m_changed.notify_all();
+}
+
+int TileBatchGenerator::tileCount() const
+{
+	// same layout and counts as tilePositions
+	const int rows = m_params.width;
+	const int cols = m_params.height;
+	const int size = m_sampling.tileSize;
+	if (size <= 0 || size > rows || size > cols)
+	{
+		return 0;
+	}
+
+	int count = std::max(0, m_sampling.randomCrops);
+	if (m_sampling.stride > 0)
+	{
+		count += static_cast<int>(gridStarts(cols, size, m_sampling.stride).size() * gridStarts(rows, size, m_sampling.stride).size());
+	}
+	return count;
+}
+
+int TileBatchGenerator::completed() const
+{
+	return m_completed;
+}
+
+int TileBatchGenerator::written() const
+{
+	return m_written;
+}
+
+int TileBatchGenerator::skipped() const
+{
+	return m_skipped;
+}
+
+int TileBatchGenerator::failed() const
+{
+	return m_failed;
+}
+
+void TileBatchGenerator::setCollectStats(bool collect)
+{
+	m_collectStats = collect;
+}
+
+SampleStats TileBatchGenerator::totalStats() const
+{
+	SampleStats total;
+	for (const auto& stats : m_stats)
+	{
+		total.add(stats);
+	}
+	return total;
+}
+
+void TileBatchGenerator::setProgressCallback(std::function<void(int)> callback)
+{
+	m_progressCallback = std::move(callback);
+}
+
+void TileBatchGenerator::workerLoop(DatasetWriter& writer, int count)
+{
+#ifdef _OPENMP
+	// tiles run in parallel, nested OpenMP teams would only oversubscribe the cores
+	omp_set_num_threads(1);
+#endif
+
+	while (true)
+	{
+		std::shared_ptr<Canvas> canvas;
+		size_t tile = 0;
+		int create = -1;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			auto openCanvas = [this]()
+				{
+					auto found = std::find_if(m_canvases.begin(), m_canvases.end(), [](const auto& c) { return c->next < c->tiles.size(); });
+					return found != m_canvases.end() ? *found : nullptr;
+				};
+			auto canCreate = [this, count]() { return m_nextCanvas < count && m_canvases.size() + m_creating < kCanvasesInFlight; };
+			auto finished = [this, count]() { return m_nextCanvas >= count && m_creating == 0; };
+
+			m_changed.wait(lock, [&]() { return m_canceled || openCanvas() || canCreate() || finished(); });
+			if (m_canceled)
+			{
+				break;
+			}
+
+			canvas = openCanvas();
+			if (canvas)
+			{
+				tile = canvas->next++;
+			}
+			else if (canCreate())
+			{
+				create = m_nextCanvas++;
+				++m_creating;
+			}
+			else
+			{
+				// no tile left and none will come, the other workers finish the taken ones
+				break;
+			}
+		}
+
+		if (create >= 0)
+		{
+			SampleStats* stats = m_collectStats && tileCount() > 0 ? &m_stats[create * tileCount()] : nullptr;
+			std::shared_ptr<Canvas> created = createCanvas(create, stats);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				--m_creating;
+				if (created->tiles.empty())
+				{
+					finishCanvas();
+				}
+				else
+				{
+					m_canvases.push_back(created);
+				}
+			}
+			m_changed.notify_all();
+			continue;
+		}
+
+		RandomGenerator gen = RandomGenerator::forSample(canvas->seed, tile);
+		// every tile has its own entry, workers never share one
+		SampleStats* stats = m_collectStats ? &m_stats[canvas->index * tileCount() + tile] : nullptr;
+		GenImg result = ImageGenerator::generateTile(m_params, m_wellParams, canvas->field, canvas->tiles[tile], gen, m_sampling.minContours, &m_canceled,
+			stats);
+		if (!result.image.empty())
+		{
+			// blocks while the writer queue is full, which bounds the tiles in memory
+			writer.write(canvas->firstIndex + static_cast<int>(tile), result.image, result.mask, stats);
+			++m_written;
+		}
+		else if (!m_canceled)
+		{
+			++m_skipped;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (++canvas->done == canvas->tiles.size())
+			{
+				m_canvases.erase(std::find(m_canvases.begin(), m_canvases.end(), canvas));
+				finishCanvas();
+			}
+		}
+		m_changed.notify_all();
+	}
+}
+
+std::shared_ptr<TileBatchGenerator::Canvas> TileBatchGenerator::createCanvas(int index, SampleStats* stats) const
+{
+	auto canvas = std::make_shared<Canvas>();
+	canvas->index = index;
+	canvas->firstIndex = m_firstIndex + index * tileCount();
+
+	RandomGenerator gen = RandomGenerator::forSample(m_baseSeed, index);
+	canvas->seed = gen.seed();
+	if (m_params.generateIsolines)
+	{
+		StageTimer timer(stats, Stage::NOISE);
+		canvas->field = ContoursOperations::generateField(m_params, gen);
+	}
+	canvas->tiles = tilePositions(gen);
+	return canvas;
+}
+
+std::vector<cv::Rect> TileBatchGenerator::tilePositions(RandomGenerator& gen) const
+{
+	// layout of generateField: params.width rows, params.height cols
+	const int rows = m_params.width;
+	const int cols = m_params.height;
+	const int size = m_sampling.tileSize;
+
+	std::vector<cv::Rect> tiles;
+	if (size <= 0 || size > rows || size > cols)
+	{
+		return tiles;
+	}
+
+	if (m_sampling.stride > 0)
+	{
+		// same order as DatasetWriter::writeSplit: columns first
+		std::vector<int> xs = gridStarts(cols, size, m_sampling.stride);
+		std::vector<int> ys = gridStarts(rows, size, m_sampling.stride);
+		for (int x : xs)
+		{
+			for (int y : ys)
+			{
+				tiles.emplace_back(x, y, size, size);
+			}
+		}
+	}
+
+	for (int i = 0; i < m_sampling.randomCrops; ++i)
+	{
+		int x = gen.getRandomInt(cols - size + 1);
+		int y = gen.getRandomInt(rows - size + 1);
+		tiles.emplace_back(x, y, size, size);
+	}
+	return tiles;
+}
+
+void TileBatchGenerator::finishCanvas()
+{
+	int done = ++m_completed;
+	if (m_progressCallback)
+	{
+		m_progressCallback(done);
+	}
+}
+
+void TileBatchGenerator::writeStats() const
+{
+	QFile file(m_folderPath + "/stats.csv");
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+	{
+		return;
+	}
+
+	// skipped and canceled tiles keep their rows, file is the index they were reserved
+	QTextStream out(&file);
+	out << "canvas,tile,file,seed," << SampleStats::csvHeader() << "\n";
+	const int tiles = tileCount();
+	for (size_t i = 0; i < m_stats.size(); ++i)
+	{
+		int canvas = static_cast<int>(i) / tiles;
+		int tile = static_cast<int>(i) % tiles;
+		uint64_t canvasSeed = RandomGenerator::forSample(m_baseSeed, canvas).seed();
+		out << QString::number(canvas) << "," << QString::number(tile) << "," << QString::number(m_firstIndex + static_cast<int>(i)) << ","
+			<< QString::number(RandomGenerator::forSample(canvasSeed, tile).seed()) << "," << m_stats[i].csvRow() << "\n";
+	}
+	out << "total,,,," << totalStats().csvRow() << "\n";
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "EncodeOperations.h"
+#include "SampleStats.h"
+
+class DatasetWriter;
+
+// Tiles taken from every generated canvas
+struct TileSampling
+{
+    int tileSize = 256;
+    int stride = 256; // grid step, smaller than tileSize for overlapping tiles, <= 0 disables the grid
+    int randomCrops = 0; // additional tiles at random positions of every canvas
+    int minContours = 0; // tiles crossed by fewer isolines are not saved, 1 skips empty tiles
+};
+
+// Generates count canvases of params.width x params.height and saves tiles of them instead of whole images.
+// The noise field is evaluated once per canvas, so the tiles of a canvas are continuous, the rest of the pipeline
+// (tracing, fill, labels, wells and encoding) runs per tile with ImageGenerator::generateTile.
+// Workers take single tiles of the canvases in flight, so one canvas is spread over all workers
+// and at most two canvas fields are kept in memory.
+// The grid covers the whole canvas, a remainder smaller than the stride gets a tile aligned to the canvas border.
+class TileBatchGenerator
+{
+public:
+    // Canvas i is generated from RandomGenerator::forSample(baseSeed, i), its tile t from forSample(canvas seed, t)
+    TileBatchGenerator(const GenerationParams& params, const WellParams& wellParams, const QString& folderPath, uint64_t baseSeed,
+        const TileSampling& sampling = TileSampling(), const OutputFormat& format = OutputFormat());
+
+    // Blocks until all tiles are saved or the batch is canceled. numWorkers <= 0 uses all cores.
+    // Every canvas gets tileCount() file indices reserved up front, tile t of canvas i is saved at
+    // first + i * tileCount() + t, skipped tiles leave gaps in the numbering.
+    void run(int count, int numWorkers);
+    // Can be called from any thread
+    void cancel();
+
+    // Tiles of every canvas, grid and random crops, including the ones skipped later
+    int tileCount() const;
+    // Canvases whose tiles are all written or skipped
+    int completed() const;
+    int written() const;
+    int skipped() const;
+    // Tiles the writer could not save, counted in written() as well
+    int failed() const;
+    // Per-stage times and counters of every tile, written to stats.csv in the output folder after run().
+    // The field of a canvas is shared by its tiles and timed on its first tile
+    void setCollectStats(bool collect);
+    // Sums over the tiles of the last run(), empty without setCollectStats(true)
+    SampleStats totalStats() const;
+    // Called after every completed canvas, from the worker finishing it (calls are serialized)
+    void setProgressCallback(std::function<void(int)> callback);
+
+protected:
+    struct Canvas
+    {
+        int index;
+        int firstIndex; // file index of the first tile
+        uint64_t seed;
+        cv::Mat field;
+        std::vector<cv::Rect> tiles;
+        size_t next = 0; // first tile not taken by a worker
+        size_t done = 0;
+    };
+
+    void workerLoop(DatasetWriter& writer, int count);
+    std::shared_ptr<Canvas> createCanvas(int index, SampleStats* stats) const;
+    std::vector<cv::Rect> tilePositions(RandomGenerator& gen) const;
+    // Counts the canvas and reports the progress, called with m_mutex held
+    void finishCanvas();
+    void writeStats() const;
+
+private:
+    GenerationParams m_params;
+    WellParams m_wellParams;
+    QString m_folderPath;
+    OutputFormat m_format;
+    TileSampling m_sampling;
+    uint64_t m_baseSeed;
+    std::function<void(int)> m_progressCallback;
+    int m_firstIndex = 0; // file index of the first tile of canvas 0 in the last run()
+    bool m_collectStats = false;
+    std::vector<SampleStats> m_stats; // indexed by canvas * tileCount() + tile
+
+    std::atomic<int> m_completed{ 0 };
+    std::atomic<int> m_written{ 0 };
+    std::atomic<int> m_skipped{ 0 };
+    int m_failed = 0;
+    std::atomic<bool> m_canceled{ false };
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<std::shared_ptr<Canvas>> m_canvases; // in flight, in canvas order
+    int m_nextCanvas = 0;
+    int m_creating = 0; // canvases whose field is being generated
+};
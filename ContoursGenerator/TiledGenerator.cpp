@@ -0,0 +1,423 @@
+#include "TiledGenerator.h"
+#include "DatasetWriter.h"
+#include "RandomGenerator.h"
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+	// isolines at every integer level, as generateImage traces them
+	const double kLevelStep = 1.0;
+}
+
+TiledGenerator::TiledGenerator(const GenerationParams& params, const WellParams& wellParams, const QString& folderPath, uint64_t seed, int tileSize,
+	const OutputFormat& format) :
+	m_params(params)
+	, m_wellParams(wellParams)
+	, m_folderPath(folderPath)
+	, m_format(format)
+	, m_seed(seed)
+	, m_tileSize(std::max(tileSize, 2 * ImageGenerator::kTileMargin))
+	, m_rows(params.width)
+	, m_cols(params.height)
+{
+	// the noise seed is drawn like the first sample of a batch draws it
+	RandomGenerator gen = RandomGenerator::forSample(m_seed, 0);
+	m_noiseSeed = static_cast<uint32_t>(gen.getRandomInt(INT_MAX));
+
+	m_tileRows = (m_rows + m_tileSize - 1) / m_tileSize;
+	m_tileCols = (m_cols + m_tileSize - 1) / m_tileSize;
+}
+
+void TiledGenerator::run(int numWorkers)
+{
+	if (numWorkers <= 0)
+	{
+		numWorkers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	numWorkers = std::max(1, std::min(numWorkers, tileCount()));
+
+	m_nextTile = 0;
+	m_completed = 0;
+	m_failed = 0;
+	m_pieceLevel.clear();
+	m_pieceClosed.clear();
+	m_links.clear();
+	m_openEnds.clear();
+	m_contourCount = 0;
+	m_stats.assign(m_collectStats ? tileCount() : 0, SampleStats());
+
+	QDir().mkpath(m_folderPath);
+	m_isolinesFile.setFileName(m_folderPath + "/isolines.bin");
+	m_outputsOk = m_isolinesFile.open(QIODevice::WriteOnly);
+	m_isolines.setDevice(&m_isolinesFile);
+	m_isolines.setByteOrder(QDataStream::LittleEndian);
+	m_isolines.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+	// two tiles per worker in the queue are enough to hide the saving latency
+	DatasetWriter writer(m_folderPath, m_format, 0, 2 * numWorkers);
+	int firstIndex = writer.reserve(tileCount());
+
+	std::vector<std::thread> workers;
+	workers.reserve(numWorkers);
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		workers.emplace_back(&TiledGenerator::workerLoop, this, std::ref(writer), firstIndex);
+	}
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	writer.finish();
+	m_failed = writer.failed();
+
+	// a failed write leaves the stream status set for good
+	m_outputsOk = m_outputsOk && m_isolines.status() == QDataStream::Ok && m_isolinesFile.flush();
+	m_isolines.setDevice(nullptr);
+	m_isolinesFile.close();
+
+	m_outputsOk = writeContours() && m_outputsOk;
+	m_outputsOk = writeMap(firstIndex) && m_outputsOk;
+	if (m_collectStats)
+	{
+		writeStats(firstIndex);
+	}
+}
+
+void TiledGenerator::cancel()
+{
+	m_canceled = true;
+}
+
+int TiledGenerator::tileCount() const
+{
+	return m_tileRows * m_tileCols;
+}
+
+int TiledGenerator::completed() const
+{
+	return m_completed;
+}
+
+int TiledGenerator::failed() const
+{
+	return m_failed;
+}
+
+bool TiledGenerator::outputsOk() const
+{
+	return m_outputsOk;
+}
+
+void TiledGenerator::setCollectStats(bool collect)
+{
+	m_collectStats = collect;
+}
+
+SampleStats TiledGenerator::totalStats() const
+{
+	SampleStats total;
+	for (const auto& stats : m_stats)
+	{
+		total.add(stats);
+	}
+	return total;
+}
+
+void TiledGenerator::setProgressCallback(std::function<void(int)> callback)
+{
+	m_progressCallback = std::move(callback);
+}
+
+bool TiledGenerator::EndKey::operator==(const EndKey& other) const
+{
+	return x == other.x && y == other.y && level == other.level;
+}
+
+size_t TiledGenerator::EndKeyHash::operator()(const EndKey& key) const
+{
+	uint32_t x, y;
+	std::memcpy(&x, &key.x, sizeof(x));
+	std::memcpy(&y, &key.y, sizeof(y));
+	uint64_t h = (static_cast<uint64_t>(x) << 32 | y) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(h ^ (h >> 29) ^ static_cast<uint64_t>(key.level));
+}
+
+void TiledGenerator::workerLoop(DatasetWriter& writer, int firstIndex)
+{
+#ifdef _OPENMP
+	// every worker runs a whole tile, nested OpenMP teams would only oversubscribe the cores
+	omp_set_num_threads(1);
+#endif
+
+	std::vector<ContoursOperations::Isoline> pieces;
+	while (!m_canceled)
+	{
+		int tile = m_nextTile++;
+		if (tile >= tileCount())
+		{
+			break;
+		}
+
+		// every tile has its own entry, workers never share one
+		SampleStats* stats = m_collectStats ? &m_stats[tile] : nullptr;
+		GenImg gen = generateTile(tile, pieces, stats);
+		if (m_canceled)
+		{
+			break;
+		}
+		// blocks while the writer queue is full, which bounds the tiles in memory
+		writer.write(firstIndex + tile, gen.image, gen.mask, stats);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		addPieces(tile, pieces);
+		int done = ++m_completed;
+		if (m_progressCallback)
+		{
+			m_progressCallback(done);
+		}
+	}
+}
+
+GenImg TiledGenerator::generateTile(int tile, std::vector<ContoursOperations::Isoline>& pieces, SampleStats* stats) const
+{
+	pieces.clear();
+
+	int row = tile / m_tileCols;
+	int col = tile % m_tileCols;
+	cv::Rect core(col * m_tileSize, row * m_tileSize, std::min(m_tileSize, m_cols - col * m_tileSize), std::min(m_tileSize, m_rows - row * m_tileSize));
+
+	// wells of a tile are reproducible from (seed, tile)
+	RandomGenerator gen = RandomGenerator::forSample(m_seed, tile);
+	if (!m_params.generateIsolines)
+	{
+		return ImageGenerator::generateTile(m_params, m_wellParams, cv::Mat(), core, gen, 0, &m_canceled, stats);
+	}
+
+	// only the part of the field the tile needs is evaluated
+	const int margin = ImageGenerator::kTileMargin;
+	cv::Rect region = cv::Rect(core.x - margin, core.y - margin, core.width + 2 * margin, core.height + 2 * margin) & cv::Rect(0, 0, m_cols, m_rows);
+	cv::Rect local = core - region.tl();
+	cv::Mat field;
+	{
+		StageTimer timer(stats, Stage::NOISE);
+		field = ContoursOperations::generateFieldRegion(m_params, m_noiseSeed, region);
+	}
+
+	// pieces for the stitching: cells of the core and of its right and bottom seam, which belong to this tile
+	{
+		StageTimer timer(stats, Stage::TRACING);
+		cv::Rect cells(local.x, local.y, std::min(local.width + 1, field.cols - local.x), std::min(local.height + 1, field.rows - local.y));
+		pieces = ContoursOperations::traceIsolines(field(cells), kLevelStep);
+		cv::Point2f pieceOffset(static_cast<float>(region.x + cells.x), static_cast<float>(region.y + cells.y));
+		for (auto& piece : pieces)
+		{
+			for (auto& pt : piece.points)
+			{
+				pt += pieceOffset;
+			}
+		}
+	}
+
+	return ImageGenerator::generateTile(m_params, m_wellParams, field, local, gen, 0, &m_canceled, stats);
+}
+
+void TiledGenerator::addPieces(int tile, const std::vector<ContoursOperations::Isoline>& pieces)
+{
+	for (const auto& piece : pieces)
+	{
+		if (piece.points.empty())
+		{
+			continue;
+		}
+
+		int64_t id = static_cast<int64_t>(m_pieceLevel.size());
+		m_pieceLevel.push_back(static_cast<float>(piece.level));
+		m_pieceClosed.push_back(piece.isClosed);
+		m_links.push_back(-1);
+		m_links.push_back(-1);
+
+		m_isolines << static_cast<quint32>(id) << static_cast<quint32>(tile) << static_cast<float>(piece.level)
+			<< static_cast<quint8>(piece.isClosed) << static_cast<quint32>(piece.points.size());
+		for (const auto& pt : piece.points)
+		{
+			m_isolines << pt.x << pt.y;
+		}
+
+		if (piece.isClosed)
+		{
+			continue;
+		}
+
+		// open pieces end on the map border or on a seam, seam ends are linked to the piece of the other tile
+		const cv::Point2f ends[2] = { piece.points.front(), piece.points.back() };
+		for (int e = 0; e < 2; ++e)
+		{
+			if (isMapBorder(ends[e]))
+			{
+				continue;
+			}
+
+			// a field sample exactly on a level puts nodes of two edges on the same point,
+			// such an end may stay unlinked and splits its contour in contours.bin
+			EndKey key{ ends[e].x, ends[e].y, cvRound(piece.level / kLevelStep) };
+			int64_t end = 2 * id + e;
+			auto found = m_openEnds.find(key);
+			if (found == m_openEnds.end())
+			{
+				m_openEnds.emplace(key, end);
+			}
+			else
+			{
+				m_links[end] = found->second;
+				m_links[found->second] = end;
+				m_openEnds.erase(found);
+			}
+		}
+	}
+}
+
+bool TiledGenerator::isMapBorder(const cv::Point2f& pt) const
+{
+	return pt.x <= 0 || pt.y <= 0 || pt.x >= m_cols - 1 || pt.y >= m_rows - 1;
+}
+
+bool TiledGenerator::writeContours()
+{
+	QFile file(m_folderPath + "/contours.bin");
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+	QDataStream out(&file);
+	out.setByteOrder(QDataStream::LittleEndian);
+	out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+	const int64_t pieceCount = static_cast<int64_t>(m_pieceLevel.size());
+	std::vector<bool> visited(pieceCount, false);
+	std::vector<qint32> chain;
+
+	// walk from the entry end of a piece through its other end to the linked piece
+	auto walk = [&](int64_t piece, int entry)
+		{
+			chain.clear();
+			bool closed = false;
+			while (true)
+			{
+				visited[piece] = true;
+				chain.push_back(static_cast<qint32>(entry == 0 ? piece + 1 : -(piece + 1)));
+				int64_t next = m_links[2 * piece + (1 - entry)];
+				if (next == -1)
+				{
+					break;
+				}
+				piece = next / 2;
+				entry = static_cast<int>(next % 2);
+				if (visited[piece])
+				{
+					closed = true;
+					break;
+				}
+			}
+
+			out << m_pieceLevel[std::abs(chain.front()) - 1] << static_cast<quint8>(closed) << static_cast<quint32>(chain.size());
+			for (qint32 link : chain)
+			{
+				out << link;
+			}
+			++m_contourCount;
+		};
+
+	// chains with a free end first, closed pieces and loops across seams are left
+	for (int64_t piece = 0; piece < pieceCount; ++piece)
+	{
+		if (visited[piece] || m_pieceClosed[piece])
+		{
+			continue;
+		}
+		if (m_links[2 * piece] == -1)
+		{
+			walk(piece, 0);
+		}
+		else if (m_links[2 * piece + 1] == -1)
+		{
+			walk(piece, 1);
+		}
+	}
+	for (int64_t piece = 0; piece < pieceCount; ++piece)
+	{
+		if (visited[piece])
+		{
+			continue;
+		}
+		if (m_pieceClosed[piece])
+		{
+			visited[piece] = true;
+			out << m_pieceLevel[piece] << static_cast<quint8>(1) << static_cast<quint32>(1) << static_cast<qint32>(piece + 1);
+			++m_contourCount;
+		}
+		else
+		{
+			walk(piece, 0);
+		}
+	}
+	return out.status() == QDataStream::Ok && file.flush();
+}
+
+bool TiledGenerator::writeMap(int firstIndex) const
+{
+	QJsonObject map;
+	map["width"] = m_cols;
+	map["height"] = m_rows;
+	map["tileSize"] = m_tileSize;
+	map["tileRows"] = m_tileRows;
+	map["tileCols"] = m_tileCols;
+	map["firstIndex"] = firstIndex;
+	map["tiles"] = m_completed.load();
+	map["complete"] = !m_canceled && m_completed == tileCount();
+	map["seed"] = QString::number(m_seed);
+	map["imageExtension"] = QString(EncodeOperations::extension(m_format.imageCodec)).mid(1);
+	map["maskExtension"] = QString(EncodeOperations::extension(m_format.maskCodec)).mid(1);
+	map["shards"] = m_format.shards;
+	map["pieces"] = static_cast<qint64>(m_pieceLevel.size());
+	map["contours"] = m_contourCount;
+	map["levelStep"] = kLevelStep;
+
+	QFile file(m_folderPath + "/map.json");
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+	QByteArray json = QJsonDocument(map).toJson();
+	return file.write(json) == json.size() && file.flush();
+}
+
+void TiledGenerator::writeStats(int firstIndex) const
+{
+	QFile file(m_folderPath + "/stats.csv");
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+	{
+		return;
+	}
+
+	// canceled tiles keep empty rows
+	QTextStream out(&file);
+	out << "tile,row,col,file," << SampleStats::csvHeader() << "\n";
+	for (size_t i = 0; i < m_stats.size(); ++i)
+	{
+		int tile = static_cast<int>(i);
+		out << QString::number(tile) << "," << QString::number(tile / m_tileCols) << "," << QString::number(tile % m_tileCols) << ","
+			<< QString::number(firstIndex + tile) << "," << m_stats[i].csvRow() << "\n";
+	}
+	out << "total,,,," << totalStats().csvRow() << "\n";
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <QDataStream>
+#include <QFile>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "ImageGenerator.h"
+#include "EncodeOperations.h"
+#include "SampleStats.h"
+
+class DatasetWriter;
+
+// Generates one map of params.width x params.height (rows x cols, the layout of generateField) in square tiles,
+// for maps too large for generateImage. Every tile evaluates its part of the noise field with a small margin,
+// traces, fills and labels it on its own and hands it to a DatasetWriter, so memory is bounded by the tile size
+// and the number of workers instead of the map size.
+// - regions are filled with the color of their level band, the nesting depth would need the whole map
+// - labels show the level and are kept inside their tile, so no label is cut at a seam
+// - the isoline pieces of every tile are streamed to isolines.bin and stitched across the seams by their end nodes
+//   on the shared tile edges, the neighbouring tiles compute these nodes from bit-identical field values
+//
+// Files in the output folder:
+//   map.json      map size, tile grid and the index of tile (0, 0), tile (row, col) is sample firstIndex + row * tileCols + col
+//   isolines.bin  pieces: quint32 id, quint32 tile, float level, quint8 closed, quint32 count, count x (float x, float y)
+//   stats.csv     per-stage times and counters of every tile, with setCollectStats(true)
+//   contours.bin  stitched isolines: float level, quint8 closed, quint32 count, count x qint32 (piece id + 1, negative if reversed)
+// All numbers little endian, coordinates in map pixels.
+class TiledGenerator
+{
+public:
+    TiledGenerator(const GenerationParams& params, const WellParams& wellParams, const QString& folderPath, uint64_t seed, int tileSize = 1024,
+        const OutputFormat& format = OutputFormat());
+
+    // Blocks until all tiles are saved or the map is canceled. numWorkers <= 0 uses all cores.
+    void run(int numWorkers);
+    // Can be called from any thread
+    void cancel();
+
+    int tileCount() const;
+    int completed() const;
+    // Tiles the writer could not save in the last run()
+    int failed() const;
+    // False if isolines.bin, contours.bin or map.json of the last run() could not be written completely
+    bool outputsOk() const;
+    // Per-stage times and counters of every tile, written to stats.csv in the output folder after run()
+    void setCollectStats(bool collect);
+    // Sums over the tiles of the last run(), empty without setCollectStats(true)
+    SampleStats totalStats() const;
+    // Called after every tile handed to the writer, from the worker that generated it (calls are serialized)
+    void setProgressCallback(std::function<void(int)> callback);
+
+protected:
+    // End node of a piece on a tile seam, both tiles of the seam produce the same key
+    struct EndKey
+    {
+        float x, y;
+        int level;
+
+        bool operator==(const EndKey& other) const;
+    };
+
+    struct EndKeyHash
+    {
+        size_t operator()(const EndKey& key) const;
+    };
+
+    void workerLoop(DatasetWriter& writer, int firstIndex);
+    GenImg generateTile(int tile, std::vector<ContoursOperations::Isoline>& pieces, SampleStats* stats) const;
+    void addPieces(int tile, const std::vector<ContoursOperations::Isoline>& pieces);
+    bool isMapBorder(const cv::Point2f& pt) const;
+    // Return false if the file could not be written
+    bool writeContours();
+    bool writeMap(int firstIndex) const;
+    void writeStats(int firstIndex) const;
+
+private:
+    GenerationParams m_params;
+    WellParams m_wellParams;
+    QString m_folderPath;
+    OutputFormat m_format;
+    uint64_t m_seed;
+    uint32_t m_noiseSeed; // one noise field for all tiles
+    int m_tileSize;
+    int m_rows, m_cols;
+    int m_tileRows, m_tileCols;
+    std::function<void(int)> m_progressCallback;
+    bool m_collectStats = false;
+    std::vector<SampleStats> m_stats; // indexed by tile
+
+    std::atomic<int> m_nextTile{ 0 };
+    std::atomic<int> m_completed{ 0 };
+    int m_failed = 0;
+    bool m_outputsOk = true;
+    std::atomic<bool> m_canceled{ false };
+
+    // stitching state, guarded by m_mutex. Pieces cost a few bytes each, their points are only on disk
+    std::mutex m_mutex;
+    QFile m_isolinesFile;
+    QDataStream m_isolines;
+    std::vector<float> m_pieceLevel;
+    std::vector<bool> m_pieceClosed;
+    std::vector<int64_t> m_links; // end 2 * piece + {0 first, 1 last} -> linked end of the neighbouring piece, -1 for none
+    std::unordered_map<EndKey, int64_t, EndKeyHash> m_openEnds; // seam ends waiting for the other tile
+    int m_contourCount = 0;
+};
@@ -0,0 +1,464 @@
+#include <QtGui/QGuiApplication>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QTextStream>
+#include "ContoursOperations.h"
+#include "DrawOperations.h"
+#include "BatchGenerator.h"
+#include "TiledGenerator.h"
+#include "TileBatchGenerator.h"
+#include "EncodeOperations.h"
+#include "RandomGenerator.h"
+#include <algorithm>
+
+namespace
+{
+	struct CliOptions
+	{
+		GenerationParams params;
+		WellParams wellParams;
+		QString outputFolder;
+		int count;
+		int threads;
+		bool split;
+		bool stats;
+		bool map;
+		bool tiles;
+		int tileSize; // 0 picks the default of the mode
+		TileSampling sampling;
+		bool hasSeed;
+		quint64 seed;
+		OutputFormat format;
+	};
+
+	// Defaults match the initial state of the GUI controls
+	CliOptions defaultOptions()
+	{
+		CliOptions options{};
+		options.params.width = 1024;
+		options.params.height = 1024;
+		options.params.Xmul = 0.005;
+		options.params.Ymul = 0.005;
+		options.params.mul = 20;
+		options.params.generateWells = true;
+		options.params.numOfWells = 10;
+		options.params.generateIsolines = true;
+		options.params.fillContours = true;
+		options.params.drawValues = true;
+		options.params.textDistance = 50;
+		options.params.octaves = 4;
+		options.params.persistence = 0.5;
+
+		options.wellParams.radius = 5;
+		options.wellParams.fontSize = 10;
+		options.wellParams.offset = 2;
+		options.wellParams.drawText = true;
+		options.wellParams.outline = 0;
+
+		options.count = 1;
+		options.threads = 0;
+		options.split = true;
+		options.stats = false;
+		options.map = false;
+		options.tiles = false;
+		options.tileSize = 0;
+		return options;
+	}
+
+	bool parseEngine(const QString& name, ContourEngine& engine)
+	{
+		if (name == "raster")
+		{
+			engine = ContourEngine::RASTER;
+			return true;
+		}
+		if (name == "marching")
+		{
+			engine = ContourEngine::MARCHING_SQUARES;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseNoiseMode(const QString& name, NoiseMode& mode)
+	{
+		if (name == "single")
+		{
+			mode = NoiseMode::SINGLE;
+			return true;
+		}
+		if (name == "fbm")
+		{
+			mode = NoiseMode::FBM;
+			return true;
+		}
+		if (name == "ridged")
+		{
+			mode = NoiseMode::RIDGED;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseImageCodec(const QString& name, ImageCodec& codec)
+	{
+		if (name == "jpeg")
+		{
+			codec = ImageCodec::JPEG;
+			return true;
+		}
+		if (name == "png")
+		{
+			codec = ImageCodec::PNG;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseMaskCodec(const QString& name, MaskCodec& codec)
+	{
+		if (name == "jpeg")
+		{
+			codec = MaskCodec::JPEG;
+			return true;
+		}
+		if (name == "png")
+		{
+			codec = MaskCodec::PNG;
+			return true;
+		}
+		if (name == "png1")
+		{
+			codec = MaskCodec::PNG_1BIT;
+			return true;
+		}
+		if (name == "npy")
+		{
+			codec = MaskCodec::NPY;
+			return true;
+		}
+		return false;
+	}
+
+	// Read options from an INI file with [generation], [wells] and [output] groups
+	void loadConfig(const QString& path, CliOptions& options)
+	{
+		QSettings settings(path, QSettings::IniFormat);
+
+		GenerationParams& params = options.params;
+		settings.beginGroup("generation");
+		params.width = settings.value("width", params.width).toInt();
+		params.height = settings.value("height", params.height).toInt();
+		params.Xmul = settings.value("xmul", params.Xmul).toDouble();
+		params.Ymul = settings.value("ymul", params.Ymul).toDouble();
+		params.mul = settings.value("mul", params.mul).toInt();
+		params.generateIsolines = settings.value("contours", params.generateIsolines).toBool();
+		params.fillContours = settings.value("fill", params.fillContours).toBool();
+		params.drawValues = settings.value("values", params.drawValues).toBool();
+		params.textDistance = settings.value("textDistance", params.textDistance).toInt();
+		params.singlePrecision = settings.value("singlePrecision", params.singlePrecision).toBool();
+		params.inpaintTelea = settings.value("telea", params.inpaintTelea).toBool();
+		parseEngine(settings.value("engine").toString(), params.engine);
+		parseNoiseMode(settings.value("noise").toString(), params.noiseMode);
+		params.octaves = settings.value("octaves", params.octaves).toInt();
+		params.persistence = settings.value("persistence", params.persistence).toDouble();
+		settings.endGroup();
+
+		WellParams& wellParams = options.wellParams;
+		settings.beginGroup("wells");
+		params.generateWells = settings.value("enabled", params.generateWells).toBool();
+		params.numOfWells = settings.value("count", params.numOfWells).toInt();
+		wellParams.radius = settings.value("radius", wellParams.radius).toInt();
+		wellParams.fontSize = settings.value("fontSize", wellParams.fontSize).toInt();
+		wellParams.offset = settings.value("nameOffset", wellParams.offset).toInt();
+		wellParams.outline = settings.value("outline", wellParams.outline).toInt();
+		wellParams.drawText = settings.value("names", wellParams.drawText).toBool();
+		settings.endGroup();
+
+		settings.beginGroup("output");
+		options.outputFolder = settings.value("folder", options.outputFolder).toString();
+		options.count = settings.value("count", options.count).toInt();
+		options.threads = settings.value("threads", options.threads).toInt();
+		if (settings.contains("seed"))
+		{
+			options.hasSeed = true;
+			options.seed = settings.value("seed").toULongLong();
+		}
+		options.split = settings.value("split", options.split).toBool();
+		options.stats = settings.value("stats", options.stats).toBool();
+		options.map = settings.value("map", options.map).toBool();
+		options.tiles = settings.value("tiles", options.tiles).toBool();
+		options.tileSize = settings.value("tileSize", options.tileSize).toInt();
+		options.sampling.stride = settings.value("stride", options.sampling.stride).toInt();
+		options.sampling.randomCrops = settings.value("randomCrops", options.sampling.randomCrops).toInt();
+		options.sampling.minContours = settings.value("minContours", options.sampling.minContours).toInt();
+		parseImageCodec(settings.value("imageFormat").toString(), options.format.imageCodec);
+		parseMaskCodec(settings.value("maskFormat").toString(), options.format.maskCodec);
+		options.format.jpegQuality = settings.value("jpegQuality", options.format.jpegQuality).toInt();
+		options.format.pngCompression = settings.value("pngCompression", options.format.pngCompression).toInt();
+		options.format.shards = settings.value("shards", options.format.shards).toBool();
+		options.format.shardBytes = settings.value("shardSize", options.format.shardBytes >> 20).toLongLong() << 20;
+		settings.endGroup();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	// No window system is needed to render into images
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+	{
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+
+	QGuiApplication app(argc, argv);
+	QCoreApplication::setApplicationName("ContoursGeneratorCli");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Generates contour map samples without the main window");
+	parser.addHelpOption();
+
+	QCommandLineOption configOption({ "c", "config" }, "INI file with generation parameters.", "file");
+	QCommandLineOption outputOption({ "o", "output" }, "Output folder.", "folder");
+	QCommandLineOption countOption({ "n", "count" }, "Number of generated images.", "count");
+	QCommandLineOption seedOption({ "s", "seed" }, "Base seed, sample i is reproducible from (seed, i). Random by default.", "seed");
+	QCommandLineOption threadsOption({ "j", "threads" }, "Number of parallel pipelines, 0 uses all cores.", "count");
+	QCommandLineOption widthOption("width", "Image width.", "pixels");
+	QCommandLineOption heightOption("height", "Image height.", "pixels");
+	QCommandLineOption xmulOption("xmul", "X multiplier for Perlin noise.", "value");
+	QCommandLineOption ymulOption("ymul", "Y multiplier for Perlin noise.", "value");
+	QCommandLineOption mulOption("mul", "Total multiplier for Perlin noise.", "value");
+	QCommandLineOption engineOption("engine", "Contour engine: raster or marching.", "name");
+	QCommandLineOption noiseOption("noise", "Noise field: single (one octave), fbm or ridged.", "name");
+	QCommandLineOption octavesOption("octaves", "Number of octaves of fbm and ridged noise.", "count");
+	QCommandLineOption persistenceOption("persistence", "Amplitude ratio of neighbouring octaves of fbm and ridged noise.", "value");
+	QCommandLineOption floatOption("float", "Evaluate the noise field in single precision.");
+	QCommandLineOption teleaOption("telea", "Repaint contour lines and the image border with cv::inpaint (TELEA), slower.");
+	QCommandLineOption noContoursOption("no-contours", "Do not generate isolines.");
+	QCommandLineOption noFillOption("no-fill", "Do not fill contours with color.");
+	QCommandLineOption noValuesOption("no-values", "Do not draw values on isolines.");
+	QCommandLineOption textDistanceOption("text-distance", "Minimal distance between texts on isolines.", "pixels");
+	QCommandLineOption wellsOption("wells", "Number of wells, 0 disables wells.", "count");
+	QCommandLineOption wellRadiusOption("well-radius", "Well radius.", "pixels");
+	QCommandLineOption wellFontSizeOption("well-font-size", "Well name font size.", "points");
+	QCommandLineOption wellOffsetOption("well-name-offset", "Well name offset.", "pixels");
+	QCommandLineOption wellOutlineOption("well-outline", "Well outline width.", "pixels");
+	QCommandLineOption noWellNamesOption("no-well-names", "Do not draw well names.");
+	QCommandLineOption noSplitOption("no-split", "Save whole images instead of 256x256 tiles.");
+	QCommandLineOption imageFormatOption("image-format", "Image codec: jpeg or png.", "name");
+	QCommandLineOption maskFormatOption("mask-format", "Mask codec: jpeg, png, png1 (1 bit) or npy.", "name");
+	QCommandLineOption jpegQualityOption("jpeg-quality", "JPEG quality, 0-100.", "value");
+	QCommandLineOption pngCompressionOption("png-compression", "PNG compression level, 0-9.", "value");
+	QCommandLineOption mapOption("map", "Generate one map of width x height in tiles instead of count images, for maps too large for memory.");
+	QCommandLineOption tilesOption("tiles", "Evaluate the field on the whole image but render and save only tiles of it, in parallel.");
+	QCommandLineOption tileSizeOption("tile-size", "Tile size of --map (1024 by default) or --tiles (256 by default).", "pixels");
+	QCommandLineOption strideOption("stride", "Grid step of --tiles, smaller than the tile size for overlapping tiles, 0 for random crops only.", "pixels");
+	QCommandLineOption randomCropsOption("random-crops", "Tiles at random positions of every image with --tiles.", "count");
+	QCommandLineOption minContoursOption("min-contours", "Skip tiles crossed by fewer isolines with --tiles, 1 skips empty tiles.", "count");
+	QCommandLineOption shardsOption("shards", "Pack samples into tar shards with offset tables and a manifest instead of one file per image.");
+	QCommandLineOption shardSizeOption("shard-size", "Maximal shard size.", "MiB");
+	QCommandLineOption statsOption("stats", "Write per-stage times and counters of every sample (every tile with --tiles or --map) to stats.csv in the output folder.");
+
+	parser.addOptions({ configOption, outputOption, countOption, seedOption, threadsOption, widthOption, heightOption, xmulOption, ymulOption, mulOption,
+		engineOption, noiseOption, octavesOption, persistenceOption, floatOption, teleaOption, noContoursOption, noFillOption, noValuesOption, textDistanceOption, wellsOption, wellRadiusOption, wellFontSizeOption,
+		wellOffsetOption, wellOutlineOption, noWellNamesOption, noSplitOption, imageFormatOption, maskFormatOption, jpegQualityOption,
+		pngCompressionOption, shardsOption, shardSizeOption, mapOption, tilesOption, tileSizeOption,
+		strideOption, randomCropsOption, minContoursOption, statsOption });
+	parser.process(app);
+
+	CliOptions options = defaultOptions();
+	if (parser.isSet(configOption))
+	{
+		loadConfig(parser.value(configOption), options);
+	}
+
+	// Command line arguments override the config file
+	GenerationParams& params = options.params;
+	WellParams& wellParams = options.wellParams;
+	if (parser.isSet(outputOption)) options.outputFolder = parser.value(outputOption);
+	if (parser.isSet(countOption)) options.count = parser.value(countOption).toInt();
+	if (parser.isSet(seedOption))
+	{
+		options.hasSeed = true;
+		options.seed = parser.value(seedOption).toULongLong();
+	}
+	if (parser.isSet(threadsOption)) options.threads = parser.value(threadsOption).toInt();
+	if (parser.isSet(widthOption)) params.width = parser.value(widthOption).toInt();
+	if (parser.isSet(heightOption)) params.height = parser.value(heightOption).toInt();
+	if (parser.isSet(xmulOption)) params.Xmul = parser.value(xmulOption).toDouble();
+	if (parser.isSet(ymulOption)) params.Ymul = parser.value(ymulOption).toDouble();
+	if (parser.isSet(mulOption)) params.mul = parser.value(mulOption).toInt();
+	if (parser.isSet(engineOption) && !parseEngine(parser.value(engineOption), params.engine))
+	{
+		QTextStream(stderr) << "Unknown engine " << parser.value(engineOption) << Qt::endl;
+		return 1;
+	}
+	if (parser.isSet(noiseOption) && !parseNoiseMode(parser.value(noiseOption), params.noiseMode))
+	{
+		QTextStream(stderr) << "Unknown noise " << parser.value(noiseOption) << Qt::endl;
+		return 1;
+	}
+	if (parser.isSet(octavesOption)) params.octaves = parser.value(octavesOption).toInt();
+	if (parser.isSet(persistenceOption)) params.persistence = parser.value(persistenceOption).toDouble();
+	if (parser.isSet(floatOption)) params.singlePrecision = true;
+	if (parser.isSet(teleaOption)) params.inpaintTelea = true;
+	if (parser.isSet(noContoursOption)) params.generateIsolines = false;
+	if (parser.isSet(noFillOption)) params.fillContours = false;
+	if (parser.isSet(noValuesOption)) params.drawValues = false;
+	if (parser.isSet(textDistanceOption)) params.textDistance = parser.value(textDistanceOption).toInt();
+	if (parser.isSet(wellsOption))
+	{
+		params.numOfWells = parser.value(wellsOption).toInt();
+		params.generateWells = params.numOfWells > 0;
+	}
+	if (parser.isSet(wellRadiusOption)) wellParams.radius = parser.value(wellRadiusOption).toInt();
+	if (parser.isSet(wellFontSizeOption)) wellParams.fontSize = parser.value(wellFontSizeOption).toInt();
+	if (parser.isSet(wellOffsetOption)) wellParams.offset = parser.value(wellOffsetOption).toInt();
+	if (parser.isSet(wellOutlineOption)) wellParams.outline = parser.value(wellOutlineOption).toInt();
+	if (parser.isSet(noWellNamesOption)) wellParams.drawText = false;
+	if (parser.isSet(noSplitOption)) options.split = false;
+	if (parser.isSet(mapOption)) options.map = true;
+	if (parser.isSet(tilesOption)) options.tiles = true;
+	if (parser.isSet(tileSizeOption)) options.tileSize = parser.value(tileSizeOption).toInt();
+	if (parser.isSet(strideOption)) options.sampling.stride = parser.value(strideOption).toInt();
+	if (parser.isSet(randomCropsOption)) options.sampling.randomCrops = parser.value(randomCropsOption).toInt();
+	if (parser.isSet(minContoursOption)) options.sampling.minContours = parser.value(minContoursOption).toInt();
+	if (parser.isSet(imageFormatOption) && !parseImageCodec(parser.value(imageFormatOption), options.format.imageCodec))
+	{
+		QTextStream(stderr) << "Unknown image format " << parser.value(imageFormatOption) << Qt::endl;
+		return 1;
+	}
+	if (parser.isSet(maskFormatOption) && !parseMaskCodec(parser.value(maskFormatOption), options.format.maskCodec))
+	{
+		QTextStream(stderr) << "Unknown mask format " << parser.value(maskFormatOption) << Qt::endl;
+		return 1;
+	}
+	if (parser.isSet(jpegQualityOption)) options.format.jpegQuality = parser.value(jpegQualityOption).toInt();
+	if (parser.isSet(pngCompressionOption)) options.format.pngCompression = parser.value(pngCompressionOption).toInt();
+	if (parser.isSet(shardsOption)) options.format.shards = true;
+	if (parser.isSet(shardSizeOption)) options.format.shardBytes = parser.value(shardSizeOption).toLongLong() << 20;
+	if (parser.isSet(statsOption)) options.stats = true;
+
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+
+	if (options.outputFolder.isEmpty())
+	{
+		err << "Output folder is not set, use --output or [output] folder in the config file" << Qt::endl;
+		return 1;
+	}
+	if (params.width <= 0 || params.height <= 0 || options.count < 0)
+	{
+		err << "Invalid image size or count" << Qt::endl;
+		return 1;
+	}
+	if (options.format.shardBytes <= 0)
+	{
+		err << "Invalid shard size" << Qt::endl;
+		return 1;
+	}
+	if (options.tileSize < 0)
+	{
+		err << "Invalid tile size" << Qt::endl;
+		return 1;
+	}
+	if (params.octaves < 1)
+	{
+		err << "Invalid number of octaves" << Qt::endl;
+		return 1;
+	}
+	if (options.map && options.tiles)
+	{
+		err << "--map and --tiles cannot be combined" << Qt::endl;
+		return 1;
+	}
+	if (options.tiles)
+	{
+		if (options.tileSize > 0)
+		{
+			options.sampling.tileSize = options.tileSize;
+		}
+		// otherwise no canvas has a tile and nothing is saved
+		if (options.sampling.tileSize > std::min(params.width, params.height))
+		{
+			err << "Tile size is larger than the image" << Qt::endl;
+			return 1;
+		}
+		if (options.sampling.randomCrops < 0 || (options.sampling.stride <= 0 && options.sampling.randomCrops == 0))
+		{
+			err << "--tiles needs a stride > 0 or random crops" << Qt::endl;
+			return 1;
+		}
+	}
+
+	quint64 seed = options.hasSeed ? options.seed : RandomGenerator::randomSeed();
+	out << "Seed " << seed << Qt::endl;
+
+	if (options.map)
+	{
+		TiledGenerator map(params, wellParams, options.outputFolder, seed, options.tileSize > 0 ? options.tileSize : 1024, options.format);
+		map.setProgressCallback([&out, &map](int done)
+			{
+				out << "Generated tile " << done << "/" << map.tileCount() << Qt::endl;
+			});
+		map.setCollectStats(options.stats);
+		map.run(options.threads);
+		if (options.stats)
+		{
+			out << "Total " << map.totalStats().summary() << Qt::endl;
+		}
+		if (map.failed() > 0)
+		{
+			err << "Failed to save " << map.failed() << " tiles" << Qt::endl;
+		}
+		if (!map.outputsOk())
+		{
+			err << "Failed to write isolines.bin, contours.bin or map.json" << Qt::endl;
+		}
+		if (map.failed() > 0 || !map.outputsOk())
+		{
+			return 1;
+		}
+		return 0;
+	}
+
+	if (options.tiles)
+	{
+		TileBatchGenerator batch(params, wellParams, options.outputFolder, seed, options.sampling, options.format);
+		batch.setProgressCallback([&out, &options](int done)
+			{
+				out << "Generated " << done << "/" << options.count << Qt::endl;
+			});
+		batch.setCollectStats(options.stats);
+		batch.run(options.count, options.threads);
+		if (options.stats)
+		{
+			out << "Total " << batch.totalStats().summary() << Qt::endl;
+		}
+		out << "Saved " << batch.written() - batch.failed() << " tiles, skipped " << batch.skipped() << Qt::endl;
+		if (batch.failed() > 0)
+		{
+			err << "Failed to save " << batch.failed() << " tiles" << Qt::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	BatchGenerator batch(params, wellParams, options.outputFolder, options.split, seed, options.format);
+	batch.setProgressCallback([&out, &options](int done)
+		{
+			out << "Generated " << done << "/" << options.count << Qt::endl;
+		});
+	batch.setCollectStats(options.stats);
+	batch.run(options.count, options.threads);
+	if (options.stats)
+	{
+		out << "Total " << batch.totalStats().summary() << Qt::endl;
+	}
+	if (batch.failed() > 0)
+	{
+		err << "Failed to save " << batch.failed() << " files" << Qt::endl;
+		return 1;
+	}
+
+	return 0;
+}
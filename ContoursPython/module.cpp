@@ -0,0 +1,201 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include "ContoursCore.h"
+#include "SampleStats.h"
+#include <opencv2/imgproc.hpp>
+
+namespace py = pybind11;
+
+namespace
+{
+	// NumPy array on the pixels of mat, nothing is copied. The capsule holds a reference to the cv::Mat buffer,
+	// which is released when the array and all views of it are gone.
+	py::array toArray(const cv::Mat& mat)
+	{
+		CV_Assert(mat.depth() == CV_8U && mat.dims == 2);
+
+		std::vector<py::ssize_t> shape{ mat.rows, mat.cols };
+		std::vector<py::ssize_t> strides{ static_cast<py::ssize_t>(mat.step[0]), static_cast<py::ssize_t>(mat.elemSize()) };
+		if (mat.channels() > 1)
+		{
+			shape.push_back(mat.channels());
+			strides.push_back(static_cast<py::ssize_t>(mat.elemSize1()));
+		}
+
+		auto* owner = new cv::Mat(mat);
+		py::capsule base(owner, [](void* ptr) { delete static_cast<cv::Mat*>(ptr); });
+		return py::array(py::dtype::of<uint8_t>(), shape, strides, owner->data, base);
+	}
+
+	py::dict statsDict(const SampleStats& stats)
+	{
+		py::dict ms;
+		for (int i = 0; i < static_cast<int>(Stage::COUNT); ++i)
+		{
+			ms[stageName(static_cast<Stage>(i))] = stats.ms[i];
+		}
+
+		py::dict result;
+		result["ms"] = ms;
+		result["total_ms"] = stats.totalMs();
+		result["contours"] = stats.contours;
+		result["points"] = stats.points;
+		result["labels"] = stats.labels;
+		return result;
+	}
+
+	py::tuple paramsState(const GenerationParams& p)
+	{
+		return py::make_tuple(p.width, p.height, p.Xmul, p.Ymul, p.mul, p.generateWells, p.numOfWells, p.generateIsolines, p.fillContours,
+			p.drawValues, p.textDistance, p.singlePrecision, p.engine, p.inpaintTelea, p.noiseMode, p.octaves, p.persistence);
+	}
+
+	GenerationParams paramsFromState(const py::tuple& t)
+	{
+		if (t.size() != 17)
+		{
+			throw std::runtime_error("Invalid Params state");
+		}
+		GenerationParams p{};
+		p.width = t[0].cast<int>();
+		p.height = t[1].cast<int>();
+		p.Xmul = t[2].cast<double>();
+		p.Ymul = t[3].cast<double>();
+		p.mul = t[4].cast<int>();
+		p.generateWells = t[5].cast<bool>();
+		p.numOfWells = t[6].cast<int>();
+		p.generateIsolines = t[7].cast<bool>();
+		p.fillContours = t[8].cast<bool>();
+		p.drawValues = t[9].cast<bool>();
+		p.textDistance = t[10].cast<int>();
+		p.singlePrecision = t[11].cast<bool>();
+		p.engine = t[12].cast<ContourEngine>();
+		p.inpaintTelea = t[13].cast<bool>();
+		p.noiseMode = t[14].cast<NoiseMode>();
+		p.octaves = t[15].cast<int>();
+		p.persistence = t[16].cast<double>();
+		return p;
+	}
+
+	py::tuple wellParamsState(const WellParams& p)
+	{
+		return py::make_tuple(p.radius, p.fontSize, p.offset, p.drawText, p.outline);
+	}
+
+	WellParams wellParamsFromState(const py::tuple& t)
+	{
+		if (t.size() != 5)
+		{
+			throw std::runtime_error("Invalid WellParams state");
+		}
+		WellParams p{};
+		p.radius = t[0].cast<int>();
+		p.fontSize = t[1].cast<int>();
+		p.offset = t[2].cast<int>();
+		p.drawText = t[3].cast<bool>();
+		p.outline = t[4].cast<int>();
+		return p;
+	}
+}
+
+// Samples are generated in the calling process and returned as NumPy arrays sharing the generated buffers,
+// so DataLoader workers skip encoding, disk and decoding:
+//
+//   import contours
+//   params = contours.Params()
+//   params.width = params.height = 256
+//   generator = contours.Generator(params, contours.WellParams(), seed=1)
+//   image, mask = generator.sample(index, rgb=True)  # uint8 (H, W, 3) and (H, W)
+//
+// Generators are picklable, so they can live in a Dataset passed to spawned workers.
+PYBIND11_MODULE(contours, m)
+{
+	m.doc() = "Contour map samples generated in memory";
+
+	py::enum_<ContourEngine>(m, "Engine")
+		.value("RASTER", ContourEngine::RASTER)
+		.value("MARCHING_SQUARES", ContourEngine::MARCHING_SQUARES);
+
+	py::enum_<NoiseMode>(m, "NoiseMode")
+		.value("SINGLE", NoiseMode::SINGLE)
+		.value("FBM", NoiseMode::FBM)
+		.value("RIDGED", NoiseMode::RIDGED);
+
+	// width is the number of rows of the field and height the number of columns, as in the GUI
+	py::class_<GenerationParams>(m, "Params")
+		.def(py::init(&ContoursCore::defaultParams))
+		.def_readwrite("width", &GenerationParams::width)
+		.def_readwrite("height", &GenerationParams::height)
+		.def_readwrite("xmul", &GenerationParams::Xmul)
+		.def_readwrite("ymul", &GenerationParams::Ymul)
+		.def_readwrite("mul", &GenerationParams::mul)
+		.def_readwrite("generate_wells", &GenerationParams::generateWells)
+		.def_readwrite("num_wells", &GenerationParams::numOfWells)
+		.def_readwrite("generate_isolines", &GenerationParams::generateIsolines)
+		.def_readwrite("fill_contours", &GenerationParams::fillContours)
+		.def_readwrite("draw_values", &GenerationParams::drawValues)
+		.def_readwrite("text_distance", &GenerationParams::textDistance)
+		.def_readwrite("single_precision", &GenerationParams::singlePrecision)
+		.def_readwrite("engine", &GenerationParams::engine)
+		.def_readwrite("inpaint_telea", &GenerationParams::inpaintTelea)
+		.def_readwrite("noise_mode", &GenerationParams::noiseMode)
+		.def_readwrite("octaves", &GenerationParams::octaves)
+		.def_readwrite("persistence", &GenerationParams::persistence)
+		.def(py::pickle(&paramsState, &paramsFromState));
+
+	// the well color is random per sample
+	py::class_<WellParams>(m, "WellParams")
+		.def(py::init(&ContoursCore::defaultWellParams))
+		.def_readwrite("radius", &WellParams::radius)
+		.def_readwrite("font_size", &WellParams::fontSize)
+		.def_readwrite("name_offset", &WellParams::offset)
+		.def_readwrite("draw_names", &WellParams::drawText)
+		.def_readwrite("outline", &WellParams::outline)
+		.def(py::pickle(&wellParamsState, &wellParamsFromState));
+
+	py::class_<ContoursCore::SampleGenerator>(m, "Generator")
+		.def(py::init<const GenerationParams&, const WellParams&, uint64_t>(), py::arg("params"), py::arg("well_params"), py::arg("seed"))
+		.def_property_readonly("params", &ContoursCore::SampleGenerator::params)
+		.def_property_readonly("well_params", &ContoursCore::SampleGenerator::wellParams)
+		.def_property_readonly("seed", &ContoursCore::SampleGenerator::baseSeed)
+		.def("sample", [](const ContoursCore::SampleGenerator& generator, uint64_t index, bool rgb)
+			{
+				GenImg gen;
+				{
+					// other Python threads keep running while the sample is generated
+					py::gil_scoped_release release;
+					gen = generator.generate(index);
+					if (rgb)
+					{
+						cv::cvtColor(gen.image, gen.image, cv::COLOR_BGR2RGB);
+					}
+				}
+				return py::make_tuple(toArray(gen.image), toArray(gen.mask));
+			}, py::arg("index"), py::arg("rgb") = false,
+			"Image (H, W, 3) in BGR order, or RGB with rgb=True, and mask (H, W), both uint8 and not copied.")
+		.def("stats", [](const ContoursCore::SampleGenerator& generator, uint64_t index)
+			{
+				SampleStats stats;
+				{
+					py::gil_scoped_release release;
+					generator.generate(index, &stats);
+				}
+				return statsDict(stats);
+			}, py::arg("index"), "Generates a sample and returns its stage times and counters instead of the pixels.")
+		.def(py::pickle(
+			[](const ContoursCore::SampleGenerator& generator)
+			{
+				return py::make_tuple(paramsState(generator.params()), wellParamsState(generator.wellParams()), generator.baseSeed());
+			},
+			[](const py::tuple& t)
+			{
+				if (t.size() != 3)
+				{
+					throw std::runtime_error("Invalid Generator state");
+				}
+				return ContoursCore::SampleGenerator(paramsFromState(t[0].cast<py::tuple>()), wellParamsFromState(t[1].cast<py::tuple>()), t[2].cast<uint64_t>());
+			}));
+
+	// the application is created on import, which runs on the main thread of the interpreter
+	ContoursCore::ensureApplication();
+}